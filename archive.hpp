@@ -0,0 +1,400 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "players.hpp"
+
+// Append-only archive of games with secondary indexes, in a directory:
+//
+// games.bin - Arch_rec per game, game id is the place in the file
+// index.bin - run*, run := "MRUN" first:u64 count:u32 (key:u32 * count) * arch_fields_
+//
+// Games are appended as they end and every arch_run_ of them are sealed
+// into a run: per field the keys value << 16 | (id - first), sorted, so
+// the games of a value or a range of values are one binary search away.
+// Readers map both files and AND the matches of a run in a bitset; games
+// past the last run are scanned.
+
+enum Arch_field
+{
+    ARCH_N,
+    ARCH_MAFIA,
+    ARCH_DOCS,
+    ARCH_COMAS,
+    ARCH_MANAS,
+    ARCH_WINNER,
+    ARCH_DAYS,
+    ARCH_SAVES,
+    ARCH_SAVED_MANA,  // Doc saves of the Mana's target
+    ARCH_SAVED_COMA,
+    ARCH_SAVED_MAFIA,
+    ARCH_KICKS,
+};
+
+const int arch_fields_ = ARCH_KICKS + 1;
+const uint32_t arch_run_ = 1 << 16;
+
+const char *arch_names[arch_fields_] = {
+    "N", "mafia", "docs", "comas", "manas", "winner", "days",
+    "saves", "saved_mana", "saved_coma", "saved_mafia", "kicks",
+};
+
+struct Arch_rec
+{
+    uint64_t seed_;
+    uint16_t f_[arch_fields_];
+};
+
+struct Arch_run_head
+{
+    char magic_[4];
+    uint32_t count_;
+    uint64_t first_;
+};
+
+Arch_rec arch_rec(const Game_rec &rec) {
+    Arch_rec a{rec.seed_, {}};
+    int f[arch_fields_] = {
+        rec.N_, rec.mafia_count_, rec.doc_count_, rec.coma_count_, rec.mana_count_,
+        rec.winner_, rec.days_, rec.saves_,
+        rec.saved_[MANA], rec.saved_[COMA], rec.saved_[MAFIA], rec.kills_[VOTE],
+    };
+
+    for (int i = 0; i < arch_fields_; ++i)
+        a.f_[i] = std::min(f[i], 0xffff);
+
+    return a;
+}
+
+class Archive_writer
+{
+    std::string dir_;
+    std::ofstream games_;
+    std::ofstream index_;
+    std::mutex mut_;
+    uint64_t first_{0};            // first game not in a run
+    std::vector<Arch_rec> tail_;   // the games from first_ on
+
+    // the games of a run reach the disk before the run does
+    void sync_games(void) {
+        games_.flush();
+
+        int fd = open((dir_ + "/games.bin").c_str(), O_RDONLY);
+        if (fd >= 0) {
+            fsync(fd);
+            close(fd);
+        }
+    }
+
+    // the first arch_run_ games of tail_ into a run
+    void seal(void) {
+        sync_games();
+
+        uint32_t n = std::min<size_t>(tail_.size(), arch_run_);
+        Arch_run_head head{{'M', 'R', 'U', 'N'}, n, first_};
+        std::vector<uint32_t> keys(n);
+
+        index_.write(reinterpret_cast<const char *>(&head), sizeof(head));
+
+        for (int f = 0; f < arch_fields_; ++f) {
+            for (uint32_t i = 0; i < n; ++i)
+                keys[i] = uint32_t(tail_[i].f_[f]) << 16 | i;
+
+            std::sort(keys.begin(), keys.end());
+            index_.write(reinterpret_cast<const char *>(keys.data()), keys.size() * sizeof(uint32_t));
+        }
+
+        index_.flush();
+        first_ += n;
+        tail_.erase(tail_.begin(), tail_.begin() + n);
+    }
+
+public:
+    // continues the archive in dir if there is one
+    Archive_writer (const std::string &dir) :
+        dir_(dir)
+    {
+        mkdir(dir_.c_str(), 0755);
+
+        struct stat st;
+        std::string games_path = dir_ + "/games.bin", index_path = dir_ + "/index.bin";
+        uint64_t recs = stat(games_path.c_str(), &st) ? 0 : st.st_size / sizeof(Arch_rec);
+        uint64_t index_size = stat(index_path.c_str(), &st) ? 0 : st.st_size;
+
+        // the whole runs of games there are; a crash may have torn the last
+        std::ifstream index(index_path, std::ios::binary);
+        Arch_run_head head;
+        uint64_t at = 0;
+        while (index.read(reinterpret_cast<char *>(&head), sizeof(head))) {
+            uint64_t next = at + sizeof(head) + uint64_t(head.count_) * sizeof(uint32_t) * arch_fields_;
+
+            if (memcmp(head.magic_, "MRUN", 4) || head.first_ != first_ || next > index_size ||
+                    head.first_ + head.count_ > recs)
+                break;
+
+            first_ = head.first_ + head.count_;
+            at = next;
+            index.seekg(at);
+        }
+        index.close();
+
+        // games past the last run go back to tail_
+        std::ifstream games(games_path, std::ios::binary);
+        games.seekg(first_ * sizeof(Arch_rec));
+        Arch_rec rec;
+        while (games.read(reinterpret_cast<char *>(&rec), sizeof(rec)))
+            tail_.push_back(rec);
+        games.close();
+
+        // and the torn ends go, so appends stay aligned
+        if (index_size > at)
+            truncate(index_path.c_str(), at);
+        uint64_t whole = (first_ + tail_.size()) * sizeof(Arch_rec);
+        if (!stat(games_path.c_str(), &st) && uint64_t(st.st_size) > whole)
+            truncate(games_path.c_str(), whole);
+
+        games_.open(dir_ + "/games.bin", std::ios::binary | std::ios::app);
+        index_.open(dir_ + "/index.bin", std::ios::binary | std::ios::app);
+
+        // the runs a torn index lost
+        while (good() && tail_.size() >= arch_run_)
+            seal();
+    }
+
+    Archive_writer (const Archive_writer &) = delete;
+    Archive_writer &operator=(const Archive_writer &) = delete;
+
+    bool good(void) const {
+        return bool(games_) && bool(index_);
+    }
+
+    void add(const Game_rec &rec) {
+        Arch_rec a = arch_rec(rec);
+
+        std::lock_guard<std::mutex> lg{mut_};
+
+        games_.write(reinterpret_cast<const char *>(&a), sizeof(a));
+        tail_.push_back(a);
+
+        if (tail_.size() == arch_run_)
+            seal();
+    }
+
+    // the tail is not sealed, it stays in games.bin for the next writer
+    ~Archive_writer() {
+        games_.flush();
+    }
+};
+
+// field = value or lo..hi, both ends in
+struct Arch_cond
+{
+    int field_;
+    uint32_t lo_;
+    uint32_t hi_;
+};
+
+class Archive_reader
+{
+    struct Map
+    {
+        const char *p_{nullptr};
+        size_t size_{0};
+    };
+
+    Map games_;
+    Map index_;
+    std::vector<const Arch_run_head *> runs_;
+    uint64_t indexed_{0};
+
+    static Map map(const std::string &path) {
+        Map m;
+        int fd = open(path.c_str(), O_RDONLY);
+        struct stat st;
+
+        if (fd < 0)
+            return m;
+
+        if (!fstat(fd, &st) && st.st_size > 0) {
+            void *p = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+            if (p != MAP_FAILED) {
+                m.p_ = static_cast<const char *>(p);
+                m.size_ = st.st_size;
+            }
+        }
+
+        close(fd);
+        return m;
+    }
+
+    const uint32_t *keys(const Arch_run_head *run, const int &field) const {
+        return reinterpret_cast<const uint32_t *>(run + 1) + uint64_t(run->count_) * field;
+    }
+
+public:
+    Archive_reader (const std::string &dir) :
+        games_(map(dir + "/games.bin")),
+        index_(map(dir + "/index.bin"))
+    {
+        size_t at = 0;
+
+        // a run torn by a crash, or past the games there are, ends the index
+        while (at + sizeof(Arch_run_head) <= index_.size_) {
+            auto run = reinterpret_cast<const Arch_run_head *>(index_.p_ + at);
+            size_t next = at + sizeof(Arch_run_head) + uint64_t(run->count_) * sizeof(uint32_t) * arch_fields_;
+
+            if (memcmp(run->magic_, "MRUN", 4) || run->count_ > arch_run_ || next > index_.size_ ||
+                    run->first_ != indexed_ || run->first_ + run->count_ > games())
+                break;
+
+            runs_.push_back(run);
+            indexed_ = run->first_ + run->count_;
+            at = next;
+        }
+    }
+
+    Archive_reader (const Archive_reader &) = delete;
+    Archive_reader &operator=(const Archive_reader &) = delete;
+
+    uint64_t games(void) const {
+        return games_.size_ / sizeof(Arch_rec);
+    }
+
+    uint64_t indexed(void) const {
+        return indexed_;
+    }
+
+    const Arch_rec &rec(const uint64_t &id) const {
+        return reinterpret_cast<const Arch_rec *>(games_.p_)[id];
+    }
+
+    // ids of the games that meet all of conds, in order
+    template <typename F>
+    void query(const std::vector<Arch_cond> &conds, F &&found) const {
+        std::vector<uint64_t> bits(arch_run_ / 64);
+        std::vector<uint64_t> now(arch_run_ / 64);
+
+        for (auto run : runs_) {
+            bool first = true;
+
+            for (auto &c : conds) {
+                const uint32_t *k = keys(run, c.field_);
+                const uint32_t *b = std::lower_bound(k, k + run->count_, c.lo_ << 16);
+                const uint32_t *e = std::upper_bound(k, k + run->count_, (c.hi_ << 16) | 0xffff);
+                std::fill(now.begin(), now.end(), 0);
+
+                for (; b < e; ++b)
+                    now[(*b & 0xffff) >> 6] |= uint64_t(1) << (*b & 63);
+
+                for (size_t w = 0; w < bits.size(); ++w)
+                    bits[w] = first ? now[w] : bits[w] & now[w];
+                first = false;
+            }
+
+            if (first)
+                std::fill(bits.begin(), bits.end(), ~uint64_t(0));
+
+            for (size_t w = 0; w < bits.size(); ++w)
+                for (uint64_t m = bits[w]; m; m &= m - 1) {
+                    uint64_t id = w * 64 + __builtin_ctzll(m);
+                    if (id < run->count_)
+                        found(run->first_ + id);
+                }
+        }
+
+        for (uint64_t id = indexed_; id < games(); ++id) {
+            bool ok = true;
+            for (auto &c : conds)
+                ok &= rec(id).f_[c.field_] >= c.lo_ && rec(id).f_[c.field_] <= c.hi_;
+            if (ok)
+                found(id);
+        }
+    }
+
+    ~Archive_reader() {
+        if (games_.p_)
+            munmap(const_cast<char *>(games_.p_), games_.size_);
+        if (index_.p_)
+            munmap(const_cast<char *>(index_.p_), index_.size_);
+    }
+};
+
+// conds like winner=3 days=3 or days=5..8; prints the count and the first
+// `list` games
+bool query_archive(const std::string &dir, const std::vector<std::string> &args, const int &list = 10) {
+    std::vector<Arch_cond> conds;
+
+    for (auto &a : args) {
+        size_t eq = a.find('=');
+        int field = -1;
+
+        for (int f = 0; f < arch_fields_; ++f)
+            if (a.substr(0, eq) == arch_names[f])
+                field = f;
+
+        if (eq == std::string::npos || field == -1) {
+            std::cout << "Conditions field=value or field=lo..hi of:";
+            for (auto n : arch_names)
+                std::cout << " " << n;
+            std::cout << "\n";
+            return false;
+        }
+
+        std::string v = a.substr(eq + 1);
+        size_t dots = v.find("..");
+        uint32_t lo, hi;
+
+        try {
+            lo = std::stoul(v.substr(0, dots));
+            hi = dots == std::string::npos ? lo : std::stoul(v.substr(dots + 2));
+        } catch (const std::exception &) {
+            std::cout << "Bad value in " << a << "\n";
+            return false;
+        }
+
+        conds.push_back({field, std::min(lo, 0xffffu), std::min(hi, 0xffffu)});
+    }
+
+    using clock = std::chrono::steady_clock;
+
+    Archive_reader ar(dir);
+    std::vector<uint64_t> ids;
+    long long count = 0;
+
+    auto begin = clock::now();
+
+    ar.query(conds, [&](uint64_t id) {
+        if (count++ < list)
+            ids.push_back(id);
+    });
+
+    double ms = std::chrono::duration<double, std::milli>(clock::now() - begin).count();
+
+    std::cout << "Games " << count << " of " << ar.games() << " (" << ar.indexed()
+        << " indexed), " << ms << " ms\n";
+
+    for (auto id : ids) {
+        const Arch_rec &r = ar.rec(id);
+
+        std::cout << "game " << id << " seed " << r.seed_;
+        for (int f = 0; f < arch_fields_; ++f)
+            std::cout << " " << arch_names[f] << "=" << r.f_[f];
+        std::cout << "\n";
+    }
+    std::cout.flush();
+
+    return true;
+}
@@ -0,0 +1,215 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <barrier>
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <memory>
+#include <thread>
+#include <vector>
+
+// Combining tree barrier for many threads. The participants are ids in
+// [0, ids), fan_ consecutive ids share a leaf counter and every node
+// arrives at its parent once all of its members are in, so no counter
+// sees more than fan_ threads. The last one in at the root opens the next
+// phase. Waiters spin on the phase word for spin_ rounds, then park on it
+// (futex), and the opener only wakes them if someone parked. Spinning
+// is off by default on a single core, where it only delays the opener.
+//
+// Like std::barrier, arrive_and_drop leaves for the phases to come; a
+// node whose members all left drops out of its parent the same way.
+
+class Tree_barrier
+{
+    struct alignas(64) Node
+    {
+        std::atomic<int> count_{0};     // arrivals still due this phase
+        std::atomic<int> expected_{0};  // members of the next phases
+        int parent_{-1};
+    };
+
+    int fan_;
+    int spin_;
+    std::unique_ptr<Node[]> nodes_;     // leaves first, the root last
+    alignas(64) std::atomic<uint64_t> phase_{0};
+    alignas(64) std::atomic<int> parked_{0};
+
+    static void relax(void) {
+#if defined(__x86_64__) || defined(__i386__)
+        __builtin_ia32_pause();
+#endif
+    }
+
+public:
+    using arrival_token = uint64_t;
+
+    // member[id] - whether id takes part; spin -1 - by the cores
+    Tree_barrier (const std::vector<bool> &member, const int &spin = -1, const int &fan = 8) :
+        fan_(fan),
+        spin_(spin != -1 ? spin : std::thread::hardware_concurrency() > 1 ? 256 : 0)
+    {
+        std::vector<int> level;   // members of the nodes of the level being built
+        for (size_t i = 0; i < std::max<size_t>(member.size(), 1); i += fan_) {
+            int n = 0;
+            for (size_t j = i; j < std::min(member.size(), i + fan_); ++j)
+                n += member[j];
+            level.push_back(n);
+        }
+
+        // node counts per level, to find the parents
+        std::vector<std::vector<int>> levels = {level};
+        while (levels.back().size() > 1) {
+            std::vector<int> up;
+            for (size_t i = 0; i < levels.back().size(); i += fan_) {
+                int n = 0;
+                for (size_t j = i; j < std::min(levels.back().size(), i + fan_); ++j)
+                    n += levels.back()[j] > 0;
+                up.push_back(n);
+            }
+            levels.push_back(up);
+        }
+
+        size_t total = 0;
+        for (auto &l : levels)
+            total += l.size();
+        nodes_ = std::make_unique<Node[]>(total);
+
+        size_t at = 0;
+        for (size_t l = 0; l < levels.size(); ++l) {
+            for (size_t i = 0; i < levels[l].size(); ++i) {
+                Node &n = nodes_[at + i];
+                n.count_.store(levels[l][i], std::memory_order_relaxed);
+                n.expected_.store(levels[l][i], std::memory_order_relaxed);
+                n.parent_ = l + 1 < levels.size() ? int(at + levels[l].size() + i / fan_) : -1;
+            }
+            at += levels[l].size();
+        }
+    }
+
+    Tree_barrier (const int &count, const int &spin = -1, const int &fan = 8) :
+        Tree_barrier(std::vector<bool>(count, true), spin, fan)
+    {}
+
+    Tree_barrier (const Tree_barrier &) = delete;
+    Tree_barrier &operator=(const Tree_barrier &) = delete;
+
+    arrival_token arrive(const int &who, const bool &drop = false) {
+        arrival_token ph = phase_.load(std::memory_order_acquire);
+        int n = who / fan_;
+        bool d = drop;
+
+        while (true) {
+            Node &nd = nodes_[n];
+
+            if (d)
+                nd.expected_.fetch_sub(1, std::memory_order_relaxed);
+            if (nd.count_.fetch_sub(1, std::memory_order_acq_rel) != 1)
+                return ph;
+
+            // the last of the node, so the next phase can count here again
+            int e = nd.expected_.load(std::memory_order_relaxed);
+            nd.count_.store(e, std::memory_order_relaxed);
+            d = e == 0;
+
+            if (nd.parent_ == -1)
+                break;
+            n = nd.parent_;
+        }
+
+        phase_.fetch_add(1, std::memory_order_seq_cst);
+        if (parked_.load(std::memory_order_seq_cst))
+            phase_.notify_all();
+
+        return ph;
+    }
+
+    void wait(const arrival_token &ph) {
+        for (int i = 0; i < spin_; ++i) {
+            if (phase_.load(std::memory_order_acquire) != ph)
+                return;
+            relax();
+        }
+
+        parked_.fetch_add(1, std::memory_order_seq_cst);
+        while (phase_.load(std::memory_order_seq_cst) == ph)
+            phase_.wait(ph, std::memory_order_acquire);
+        parked_.fetch_sub(1, std::memory_order_relaxed);
+    }
+
+    void arrive_and_wait(const int &who) {
+        wait(arrive(who));
+    }
+
+    void arrive_and_drop(const int &who) {
+        arrive(who, true);
+    }
+};
+
+// Per round times of P threads going through one barrier, std::barrier
+// against Tree_barrier parked at once and spinning first
+void bench_barriers(const std::vector<int> &sizes, const double &sec_per_run = 0.5) {
+    using clock = std::chrono::steady_clock;
+
+    std::cout << "Barrier round, us:      P   rounds      p50      p99\n";
+
+    for (int p : sizes) {
+        for (int kind = 0; kind < 3; ++kind) {
+            const char *names[] = {"std::barrier", "tree, park", "tree, spin"};
+            std::barrier<> sb(p);
+            Tree_barrier tb(p, kind == 2 ? 4096 : 0);
+            std::atomic<bool> stop{false};
+            std::vector<double> rounds;
+            std::vector<std::thread> t;
+
+            auto sync = [&](const int &who) {
+                if (kind == 0)
+                    sb.arrive_and_wait();
+                else
+                    tb.arrive_and_wait(who);
+            };
+
+            for (int i = 1; i < p; ++i)
+                t.emplace_back([&, i] {
+                    while (true) {
+                        sync(i);
+                        // stop is read between two barriers, all see the same value
+                        bool s = stop.load(std::memory_order_relaxed);
+                        sync(i);
+                        if (s)
+                            return;
+                    }
+                });
+
+            auto begin = clock::now();
+            auto last = begin;
+
+            while (true) {
+                bool s = clock::now() - begin > std::chrono::duration<double>(sec_per_run);
+                if (s)
+                    stop.store(true, std::memory_order_relaxed);
+
+                sync(0);
+                sync(0);
+
+                auto now = clock::now();
+                rounds.push_back(std::chrono::duration<double, std::micro>(now - last).count() / 2);
+                last = now;
+
+                if (s)
+                    break;
+            }
+
+            for (auto &th : t)
+                th.join();
+
+            std::sort(rounds.begin(), rounds.end());
+            char line[128];
+            snprintf(line, sizeof(line), "%-14s %10d %8zu %8.1f %8.1f\n", names[kind], p, rounds.size(),
+                rounds[rounds.size() / 2], rounds[std::min(rounds.size() - 1, rounds.size() * 99 / 100)]);
+            std::cout << line;
+            std::cout.flush();
+        }
+    }
+}
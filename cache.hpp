@@ -0,0 +1,337 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "archive.hpp"
+#include "game.hpp"
+
+// Cache of simulated games on disk, addressed by what decides them: the
+// Config, the build of the bots and of every plugin, and the seeds. The
+// seeds are cut into aligned blocks of cache_block_, a block is played
+// once and then read back from the cache by any later job that covers
+// it. Blocks the job only touches at its ends are played, not stored.
+// Above game_grain_ seats a seed doesn't fix the game, a cached block is
+// then a sample of the lobby rather than the games a new run would play.
+//
+// dir/<key>.bin - key text, then block*, block := Cache_block_head
+// Arch_rec * count, appended by one write() each under flock, so the key
+// text is written once. The key is padded and every block starts at a
+// multiple of cache_align_, the file is read in place. A torn block is
+// skipped to the next aligned block head whose sums match its games, two
+// jobs storing the same block keep the first.
+
+const uint64_t cache_block_ = 4096;
+const size_t cache_align_ = 8;
+
+struct Cache_block_head
+{
+    char magic_[4];
+    uint32_t count_;
+    uint64_t block_;     // first seed / cache_block_
+    int64_t wins_[4];
+    int64_t days_;
+};
+
+struct Cache_res
+{
+    long long games_{0};
+    long long wins_[4] = {0, 0, 0, 0};
+    long long days_{0};
+    long long hit_games_{0};   // read from the cache
+    long long sim_games_{0};   // played now
+};
+
+inline uint64_t fnv1a(const void *p, const size_t &n, uint64_t h = 1469598103934665603ull) {
+    const unsigned char *c = static_cast<const unsigned char *>(p);
+
+    for (size_t i = 0; i < n; ++i)
+        h = (h ^ c[i]) * 1099511628211ull;
+
+    return h;
+}
+
+// the bytes of the shared object, so a rebuilt plugin is a new key
+inline uint64_t file_hash(const std::string &path) {
+    std::ifstream in(path, std::ios::binary);
+    std::string bytes((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+
+    return fnv1a(bytes.data(), bytes.size());
+}
+
+// all of conf that changes a game, readable
+std::string cache_key_text(const Config &conf) {
+    std::ostringstream k;
+
+    k << "mafia cache " << strategy_version_ << "\n";
+    k << "N " << conf.N_ << " mafia " << conf.mafia_count_ << " docs " << conf.doc_count_
+        << " comas " << conf.coma_count_ << " manas " << conf.mana_count_ << "\n";
+
+    k << "strategy";
+    for (int r = CIVILIAN; r <= MAFIA; ++r)
+        k << " " << conf.strategy_[r];
+    k << "\n";
+
+    // exact, 17 digits round trip a double
+    k << "params";
+    for (int i = 0; i < Bot_params::size_; ++i) {
+        char d[32];
+        snprintf(d, sizeof(d), " %.17g", conf.params_[i]);
+        k << d;
+    }
+    k << "\n";
+
+    for (int r = CIVILIAN; r <= MAFIA; ++r)
+        if (conf.plugin_[r])
+            k << "plugin " << r << " " << std::hex << file_hash(conf.plugin_[r]->path()) << std::dec << "\n";
+
+    for (auto &s : conf.seat_plugin_)
+        k << "seat " << s.first << " " << std::hex << file_hash(s.second->path()) << std::dec << "\n";
+
+    // after the rest, so the keys without it stay the same
+    if (conf.crn_)
+        k << "crn\n";
+
+    if (conf.early_end_)
+        k << "early\n";
+
+    if (conf.policy_)
+        k << "policy " << std::hex << fnv1a(conf.policy_->p_.data(), conf.policy_->p_.size() * sizeof(float))
+            << std::dec << "\n";
+
+    return k.str();
+}
+
+class Result_cache
+{
+    std::string path_;
+    std::string key_;
+    const char *map_{nullptr};
+    size_t size_{0};
+    std::map<uint64_t, const Cache_block_head *> blocks_;
+    std::mutex mut_;
+
+    // the block at `at` is all there and its sums are of its games
+    bool whole(const Cache_block_head *b, const size_t &at) const {
+        if (std::memcmp(b->magic_, "MBLK", 4) || b->count_ != cache_block_ ||
+                at + sizeof(Cache_block_head) + size_t(b->count_) * sizeof(Arch_rec) > size_)
+            return false;
+
+        int64_t wins[4] = {0, 0, 0, 0}, days = 0;
+        for (uint32_t i = 0; i < b->count_; ++i) {
+            ++wins[games(b)[i].f_[ARCH_WINNER] & 3];
+            days += games(b)[i].f_[ARCH_DAYS];
+        }
+
+        return !std::memcmp(wins, b->wins_, sizeof(wins)) && days == b->days_;
+    }
+
+public:
+    Result_cache (const std::string &dir, const Config &conf) :
+        key_(cache_key_text(conf))
+    {
+        key_.resize((key_.size() + cache_align_ - 1) / cache_align_ * cache_align_, '\n');
+
+        char name[32];
+        snprintf(name, sizeof(name), "/%016llx.bin", (unsigned long long)fnv1a(key_.data(), key_.size()));
+
+        mkdir(dir.c_str(), 0755);
+        path_ = dir + name;
+
+        int fd = open(path_.c_str(), O_RDONLY);
+        struct stat st;
+
+        if (fd < 0)
+            return;
+
+        if (!fstat(fd, &st) && size_t(st.st_size) >= key_.size()) {
+            void *p = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+            if (p != MAP_FAILED) {
+                map_ = static_cast<const char *>(p);
+                size_ = st.st_size;
+            }
+        }
+        close(fd);
+
+        // another key under the same hash, don't touch it
+        if (!map_ || std::memcmp(map_, key_.data(), key_.size())) {
+            path_.clear();
+            return;
+        }
+
+        size_t at = key_.size();
+        while (at + sizeof(Cache_block_head) <= size_) {
+            auto b = reinterpret_cast<const Cache_block_head *>(map_ + at);
+            size_t bytes = sizeof(Cache_block_head) + size_t(b->count_) * sizeof(Arch_rec);
+
+            if (whole(b, at)) {
+                blocks_.emplace(b->block_, b);
+                at += bytes;
+                continue;
+            }
+
+            // on to the next aligned block head
+            do
+                at += cache_align_;
+            while (at + sizeof(Cache_block_head) <= size_ && std::memcmp(map_ + at, "MBLK", 4));
+        }
+    }
+
+    Result_cache (const Result_cache &) = delete;
+    Result_cache &operator=(const Result_cache &) = delete;
+
+    // the games of the block, nullptr if it is not cached
+    const Cache_block_head *block(const uint64_t &b) const {
+        auto it = blocks_.find(b);
+        return it == blocks_.end() ? nullptr : it->second;
+    }
+
+    static const Arch_rec *games(const Cache_block_head *b) {
+        return reinterpret_cast<const Arch_rec *>(b + 1);
+    }
+
+    // a block played now; visible to the next Result_cache of the key
+    void store(const uint64_t &b, const std::vector<Arch_rec> &recs) {
+        if (path_.empty())
+            return;
+
+        Cache_block_head head{{'M', 'B', 'L', 'K'}, uint32_t(recs.size()), b, {0, 0, 0, 0}, 0};
+        for (auto &r : recs) {
+            ++head.wins_[r.f_[ARCH_WINNER] & 3];
+            head.days_ += r.f_[ARCH_DAYS];
+        }
+
+        std::string bytes(reinterpret_cast<const char *>(&head), sizeof(head));
+        bytes.append(reinterpret_cast<const char *>(recs.data()), recs.size() * sizeof(Arch_rec));
+
+        std::lock_guard<std::mutex> lg{mut_};
+
+        int fd = open(path_.c_str(), O_WRONLY | O_CREAT | O_APPEND, 0644);
+        if (fd < 0)
+            return;
+
+        // two jobs making the file would both write the key
+        flock(fd, LOCK_EX);
+
+        // after a torn block, back on the alignment
+        struct stat st;
+        if (!fstat(fd, &st) && st.st_size == 0)
+            bytes.insert(0, key_);
+        else if (st.st_size % cache_align_)
+            bytes.insert(0, cache_align_ - st.st_size % cache_align_, '\0');
+
+        if (write(fd, bytes.data(), bytes.size()) != ssize_t(bytes.size()))
+            std::cout << "Short write to " << path_ << "\n";
+        close(fd);
+    }
+
+    ~Result_cache() {
+        if (map_)
+            munmap(const_cast<char *>(map_), size_);
+    }
+};
+
+// The games of conf on seeds [seed, seed + games), from the cache where
+// it has them. each_game, if set, gets every game's summary, in seed
+// order within a block but not across blocks.
+Cache_res cached_games(Pool &pool,
+    const std::string &dir,
+    const Config &conf,
+    const long long &games,
+    const uint64_t &seed,
+    const std::function<void(const Arch_rec &)> &each_game = nullptr)
+{
+    Result_cache cache(dir, conf);
+    Cache_res res;
+    uint64_t end = seed + games;
+
+    auto take = [&](const Arch_rec &r) {
+        ++res.wins_[r.f_[ARCH_WINNER] & 3];
+        res.days_ += r.f_[ARCH_DAYS];
+        if (each_game)
+            each_game(r);
+    };
+
+    // seeds [from, to) played now
+    auto play = [&](const uint64_t &from, const uint64_t &to) {
+        std::vector<Arch_rec> recs(to - from);
+
+        play_games(pool, to - from, conf, 0, from, [&](Game *gm, double) {
+            recs[gm->rec().seed_ - from] = arch_rec(gm->rec());
+        });
+
+        for (auto &r : recs)
+            take(r);
+        res.sim_games_ += recs.size();
+
+        return recs;
+    };
+
+    uint64_t at = seed;
+
+    while (at < end) {
+        uint64_t b = at / cache_block_;
+        uint64_t from = b * cache_block_, to = from + cache_block_;
+
+        if (from < seed || to > end) {
+            // a piece of a block at an end of the job
+            uint64_t stop = std::min(to, end);
+            play(at, stop);
+            at = stop;
+            continue;
+        }
+
+        if (const Cache_block_head *h = cache.block(b)) {
+            const Arch_rec *recs = Result_cache::games(h);
+
+            if (each_game) {
+                for (uint32_t i = 0; i < h->count_; ++i)
+                    take(recs[i]);
+            } else {
+                for (int w = 0; w < 4; ++w)
+                    res.wins_[w] += h->wins_[w];
+                res.days_ += h->days_;
+            }
+            res.hit_games_ += h->count_;
+        } else {
+            cache.store(b, play(from, to));
+        }
+
+        at = to;
+    }
+
+    res.games_ = games;
+    return res;
+}
+
+void run_cached(Pool &pool, const std::string &dir, const Config &conf, const long long &games, const uint64_t &seed) {
+    using clock = std::chrono::steady_clock;
+
+    auto begin = clock::now();
+    Cache_res res = cached_games(pool, dir, conf, games, seed);
+    double ms = std::chrono::duration<double, std::milli>(clock::now() - begin).count();
+
+    std::cout << "Games " << res.games_ << ", seeds " << seed << ".." << seed + games - 1 << "\n";
+    std::cout << "Civilian win " << res.wins_[1] << "\n";
+    std::cout << "Mafia win " << res.wins_[2] << "\n";
+    std::cout << "Mana win " << res.wins_[3] << "\n";
+    std::cout << "Average days " << (res.games_ ? double(res.days_) / res.games_ : 0) << "\n";
+    std::cout << "Cached " << res.hit_games_ << ", played " << res.sim_games_ << ", " << ms << " ms\n";
+    std::cout.flush();
+}
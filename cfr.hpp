@@ -0,0 +1,239 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "game.hpp"
+
+// Outcome sampling Monte Carlo CFR for the Policy tables of a small lobby,
+// on the games of the engine itself, so the rules are the ones of the
+// host. Every game one seat, chosen by the seed, learns: it plays the
+// current strategy mixed with eps_ of uniform exploration and keeps what
+// it did, the other seats play the current strategy. At the end its
+// regrets are updated from the win of its team, weighted by the chances it
+// took its actions with. The seats of a role share one table.
+//
+// The current strategy is regret matched once per batch and played by
+// all of its games at once on the pool; the games add to the regrets and
+// the strategy sums, flat arrays of doubles by row and action, with atomic
+// adds. The sums are weighted by the batch number (linear averaging), the
+// average strategy is what is exported.
+
+class Cfr
+{
+    Config conf_;
+    double eps_;
+    std::vector<double> regret_;     // Policy::infos_ x acts_
+    std::vector<double> sum_;        // of the strategy, the same way
+    std::vector<uint8_t> legal_;     // by row, the actions seen there
+    long long batches_{0};
+
+    static void add(double &x, const double &v) {
+        std::atomic_ref<double>(x).fetch_add(v, std::memory_order_relaxed);
+    }
+
+    // chance of the step's act in cur, over its legal actions
+    static double sigma(const Policy &cur, const Policy_step &s, const int &a) {
+        const float *p = cur.at(s.info_);
+        double ps = 0;
+
+        for (int b = 0; b < Policy::acts_; ++b)
+            ps += (s.legal_ >> b & 1) * p[b];
+
+        return ps > 0 ? p[a] / ps : 1.0 / __builtin_popcount(s.legal_);
+    }
+
+    void update(const Policy &cur, const Policy_learn &l, const int &res, const double &weight) {
+        const std::vector<Policy_step> &st = l.steps_;
+        size_t n = st.size();
+        int side = l.role_ == MAFIA ? 2 : l.role_ == MANA ? 3 : 1;
+        double u = res == side;
+
+        std::vector<double> sig(n), tail(n + 1, 1.0);
+        double q = 1;
+
+        for (size_t k = 0; k < n; ++k) {
+            sig[k] = sigma(cur, st[k], st[k].act_);
+            q *= st[k].q_;
+        }
+        for (size_t k = n; k-- > 0;)
+            tail[k] = tail[k + 1] * sig[k];
+
+        double reach = 1, reach_q = 1;   // of the seat up to step k, played and sampled
+
+        for (size_t k = 0; k < n; ++k) {
+            const Policy_step &s = st[k];
+            double w = u / q * tail[k + 1];
+
+            std::atomic_ref<uint8_t>(legal_[s.info_]).fetch_or(s.legal_, std::memory_order_relaxed);
+
+            for (int a = 0; a < Policy::acts_; ++a) {
+                if (!(s.legal_ >> a & 1))
+                    continue;
+
+                if (u)
+                    add(regret_[size_t(s.info_) * Policy::acts_ + a], w * ((a == s.act_) - sig[k]));
+                add(sum_[size_t(s.info_) * Policy::acts_ + a], weight * reach / reach_q * sigma(cur, s, a));
+            }
+
+            reach *= sig[k];
+            reach_q *= s.q_;
+        }
+    }
+
+public:
+    Cfr (const Config &conf, const double &eps = 0.4) :
+        conf_(conf),
+        eps_(eps),
+        regret_(size_t(Policy::infos_) * Policy::acts_, 0),
+        sum_(size_t(Policy::infos_) * Policy::acts_, 0),
+        legal_(Policy::infos_, 0)
+    {
+        std::fill(conf_.strategy_, conf_.strategy_ + MAFIA + 1, STRAT_POLICY);
+    }
+
+    // regret matching
+    std::shared_ptr<Policy> current(void) const {
+        auto pol = std::make_shared<Policy>();
+
+        for (int i = 0; i < Policy::infos_; ++i) {
+            const double *r = regret_.data() + size_t(i) * Policy::acts_;
+            float *p = pol->at(i);
+            double pos = 0;
+
+            for (int a = 0; a < Policy::acts_; ++a)
+                pos += std::max(r[a], 0.0);
+
+            for (int a = 0; a < Policy::acts_; ++a)
+                p[a] = pos > 0 ? std::max(r[a], 0.0) / pos : 1.0 / Policy::acts_;
+        }
+
+        return pol;
+    }
+
+    // the wins by side of the batch
+    std::vector<long long> batch(Pool &pool, const long long &games, const uint64_t &seed) {
+        auto cur = current();
+        std::vector<std::atomic<long long>> wins(4);
+        double weight = ++batches_;
+
+        cur->eps_ = eps_;
+        conf_.policy_ = cur;
+
+        play_games(pool, games, conf_, 0, seed, [&](Game *gm, double) {
+            wins[gm->res()].fetch_add(1, std::memory_order_relaxed);
+            update(*cur, *gm->learn(), gm->res(), weight);
+        });
+
+        std::vector<long long> res;
+        for (auto &w : wins)
+            res.push_back(w.load());
+        return res;
+    }
+
+    // the average strategy, rows - the rows reached
+    std::shared_ptr<Policy> average(std::vector<bool> &rows) const {
+        auto pol = std::make_shared<Policy>();
+
+        rows.assign(Policy::infos_, false);
+
+        for (int i = 0; i < Policy::infos_; ++i) {
+            const double *s = sum_.data() + size_t(i) * Policy::acts_;
+            float *p = pol->at(i);
+            double total = 0;
+
+            if (!legal_[i])
+                continue;
+            rows[i] = true;
+
+            for (int a = 0; a < Policy::acts_; ++a)
+                total += (legal_[i] >> a & 1) * s[a];
+
+            for (int a = 0; a < Policy::acts_; ++a)
+                p[a] = !(legal_[i] >> a & 1) ? 0 :
+                    total > 0 ? s[a] / total : 1.0 / __builtin_popcount(legal_[i]);
+        }
+
+        return pol;
+    }
+};
+
+// games - learning games in all, by batches of batch; the average policy
+// is written to out and played against the base bots
+void run_cfr(Pool &pool,
+    const Config &conf,
+    const long long &games,
+    const uint64_t &seed,
+    const std::string &out,
+    const long long &batch = 10000)
+{
+    using clock = std::chrono::steady_clock;
+
+    Cfr cfr(conf);
+    std::vector<long long> wins(4, 0);
+    long long played = 0, report = std::max(games / 10, batch);
+
+    auto begin = clock::now();
+
+    std::cout << "CFR of N " << conf.N_ << ", mafia " << conf.mafia_count_ << ", doc " << conf.doc_count_
+        << ", coma " << conf.coma_count_ << ", mana " << conf.mana_count_ << ", seed " << seed << "\n";
+
+    while (played < games) {
+        long long n = std::min(batch, games - played);
+        auto w = cfr.batch(pool, n, seed + played);
+
+        for (int i = 0; i < 4; ++i)
+            wins[i] += w[i];
+        played += n;
+
+        if (played % report < n || played == games) {
+            long long g = wins[1] + wins[2] + wins[3];
+            std::cout << "Games " << played << ": civilian " << double(wins[1]) / g << " mafia "
+                << double(wins[2]) / g << " mana " << double(wins[3]) / g << "\n";
+            std::cout.flush();
+            wins.assign(4, 0);
+        }
+    }
+
+    double sec = std::chrono::duration<double>(clock::now() - begin).count();
+    std::cout << "Time " << sec << " s, " << played / sec << " games/s\n";
+
+    std::vector<bool> rows;
+    auto avg = cfr.average(rows);
+
+    if (!out.empty()) {
+        if (avg->save(out, rows))
+            std::cout << "Policy of " << std::count(rows.begin(), rows.end(), true) << " rows in " << out << "\n";
+        else
+            std::cout << "Can't write " << out << "\n";
+    }
+
+    // each team on the policy against the others on their conf strategy
+    const char *teams[] = {"civilians", "mafia", "mana"};
+    const std::vector<int> members[] = {{CIVILIAN, DOC, COMA}, {MAFIA}, {MANA}};
+    const long long eval = 20000;
+
+    for (int t = -1; t < 3; ++t) {
+        Config c = conf;
+        std::atomic<long long> w[4] = {0, 0, 0, 0};
+
+        c.policy_ = avg;
+        if (t >= 0)
+            for (int r : members[t])
+                c.strategy_[r] = STRAT_POLICY;
+
+        play_games(pool, eval, c, 0, seed + games, [&](Game *gm, double) {
+            w[gm->res()].fetch_add(1, std::memory_order_relaxed);
+        });
+
+        std::cout << (t < 0 ? "none" : teams[t]) << " on the policy: civilian " << double(w[1]) / eval
+            << " mafia " << double(w[2]) / eval << " mana " << double(w[3]) / eval << "\n";
+    }
+    std::cout.flush();
+}
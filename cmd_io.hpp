@@ -0,0 +1,282 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <vector>
+
+// Input of the human seats and the latency of their phases. The _cmd
+// players read their answers through cmd_io().in(seat): std::cin unless
+// the seat has a script. With stats on, every prompt is timed to the
+// answer and to the host's resolution of the phase.
+
+enum Cmd_phase
+{
+    CMD_VOTE,
+    CMD_NIGHT,
+};
+
+class Cmd_input
+{
+public:
+    // the next word, false at the end of the input
+    virtual bool token(std::string &t) = 0;
+    // what is left of the line
+    virtual std::string rest(void) = 0;
+    // a new prompt, the answers are looked for from here
+    virtual void prompt(void) {}
+    // the input ended because it has no answer for the prompt
+    virtual bool stuck(void) const { return false; }
+
+    virtual ~Cmd_input() = default;
+};
+
+class Stdin_input : public Cmd_input
+{
+public:
+    bool token(std::string &t) override {
+        return bool(std::cin >> t);
+    }
+
+    std::string rest(void) override {
+        std::string line;
+        std::getline(std::cin, line);
+        return line;
+    }
+};
+
+// The lines of a script, from line `from` on and round again, so a short
+// script plays any number of games. Wrong answers are read over by the
+// players' own retry loops. A vote and the night of a Doc, a Mana or a
+// Mafia take a seat number, a Coma takes "kill N" or "check N", a Mafia
+// may also "say text" first. A script with no kill or check in it ends
+// the input at the night of a human Coma: a prompt that reads the script
+// round twice, a full pass for each of its steps, has no answer there and
+// ends the input.
+class Script_input : public Cmd_input
+{
+    std::shared_ptr<const std::vector<std::vector<std::string>>> lines_;
+    size_t line_;
+    size_t word_{0};
+    size_t words_{0};   // in the script
+    size_t read_{0};    // since the prompt
+
+public:
+    Script_input (const std::shared_ptr<const std::vector<std::vector<std::string>>> &lines, const size_t &from) :
+        lines_(lines),
+        line_(lines->empty() ? 0 : from % lines->size())
+    {
+        for (auto &l : *lines_)
+            words_ += l.size();
+    }
+
+    void prompt(void) override {
+        read_ = 0;
+    }
+
+    bool stuck(void) const override {
+        return read_ > 2 * words_;
+    }
+
+    bool token(std::string &t) override {
+        if (lines_->empty() || ++read_ > 2 * words_)
+            return false;
+
+        while (word_ == (*lines_)[line_].size()) {
+            line_ = (line_ + 1) % lines_->size();
+            word_ = 0;
+        }
+
+        t = (*lines_)[line_][word_++];
+        return true;
+    }
+
+    std::string rest(void) override {
+        std::string line;
+
+        if (lines_->empty())
+            return line;
+
+        for (; word_ < (*lines_)[line_].size(); ++word_, ++read_)
+            line += " " + (*lines_)[line_][word_];
+
+        line_ = (line_ + 1) % lines_->size();
+        word_ = 0;
+
+        return line;
+    }
+
+    // words by line, empty lines dropped
+    static std::shared_ptr<const std::vector<std::vector<std::string>>> load(std::istream &in) {
+        auto lines = std::make_shared<std::vector<std::vector<std::string>>>();
+        std::string line;
+
+        while (std::getline(in, line)) {
+            std::istringstream words(line);
+            std::vector<std::string> ws;
+            std::string w;
+
+            while (words >> w)
+                ws.push_back(w);
+
+            if (!ws.empty())
+                lines->push_back(ws);
+        }
+
+        return lines;
+    }
+};
+
+struct Cmd_stats
+{
+    std::vector<int64_t> answer_;   // ns, prompt to answer
+    std::vector<int64_t> resolve_;  // ns, prompt to the host's result
+};
+
+class Cmd_io
+{
+    using clock = std::chrono::steady_clock;
+
+    Stdin_input stdin_;
+    std::vector<std::unique_ptr<Cmd_input>> in_;   // by seat, set before the game starts
+    std::atomic<bool> on_{false};
+    clock::time_point begin_{clock::now()};
+    std::vector<std::atomic<int64_t>> prompt_;     // by seat, 0 - no prompt open
+    std::vector<int> phase_;
+    std::mutex mut_;
+    Cmd_stats stats_[CMD_NIGHT + 1];
+
+    int64_t now(void) const {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(clock::now() - begin_).count() + 1;
+    }
+
+    [[noreturn]] void ended(const int &seat) {
+        if (in(seat).stuck())
+            std::cerr << "The script has no answer for seat " << seat << "\n";
+        else
+            std::cout << "Input ended\n";
+        std::cout.flush();
+        std::_Exit(1);
+    }
+
+public:
+    bool on(void) const {
+        return on_.load(std::memory_order_relaxed);
+    }
+
+    // seats - the most seats of the games to come
+    void enable(const int &seats) {
+        prompt_ = std::vector<std::atomic<int64_t>>(seats);
+        phase_.assign(seats, CMD_VOTE);
+        on_.store(true);
+    }
+
+    // nullptr gives the seat back to std::cin; not while a game runs
+    void set_input(const int &seat, std::unique_ptr<Cmd_input> in) {
+        if (in_.size() <= size_t(seat))
+            in_.resize(seat + 1);
+        in_[seat] = std::move(in);
+    }
+
+    Cmd_input &in(const int &seat) {
+        return size_t(seat) < in_.size() && in_[seat] ? *in_[seat] : stdin_;
+    }
+
+    // the seat number of the next answer, -1 if it is not a number
+    int seat(const int &seat) {
+        std::string t;
+
+        if (!in(seat).token(t))
+            ended(seat);
+
+        char *end = nullptr;
+        long v = std::strtol(t.c_str(), &end, 10);
+
+        return end != t.c_str() && !*end ? int(v) : -1;
+    }
+
+    std::string word(const int &seat) {
+        std::string t;
+
+        if (!in(seat).token(t))
+            ended(seat);
+
+        return t;
+    }
+
+    // the seat thread, right after its prompt is out
+    void prompt(const int &seat, const int &phase) {
+        in(seat).prompt();
+
+        if (!on())
+            return;
+
+        phase_[seat] = phase;
+        prompt_[seat].store(now(), std::memory_order_relaxed);
+    }
+
+    // the seat thread, once the answer is taken
+    void answered(const int &seat) {
+        int64_t p = on() ? prompt_[seat].load(std::memory_order_relaxed) : 0;
+
+        if (!p)
+            return;
+
+        std::lock_guard<std::mutex> lg{mut_};
+        stats_[phase_[seat]].answer_.push_back(now() - p);
+    }
+
+    // the host, once the phase is resolved; the barrier it passed orders
+    // the prompts before
+    void resolved(void) {
+        if (!on())
+            return;
+
+        int64_t t = now();
+        std::lock_guard<std::mutex> lg{mut_};
+
+        for (size_t i = 0; i < prompt_.size(); ++i) {
+            int64_t p = prompt_[i].exchange(0, std::memory_order_relaxed);
+            if (p)
+                stats_[phase_[i]].resolve_.push_back(t - p);
+        }
+    }
+
+    void print(std::ostream &out) {
+        const char *names[] = {"vote", "night"};
+        std::lock_guard<std::mutex> lg{mut_};
+
+        out << "Latency, us:  count      p50      p90      p99      max\n";
+
+        for (int ph = CMD_VOTE; ph <= CMD_NIGHT; ++ph)
+            for (int k = 0; k < 2; ++k) {
+                std::vector<int64_t> v = k ? stats_[ph].resolve_ : stats_[ph].answer_;
+                std::sort(v.begin(), v.end());
+
+                auto at = [&](const double &q) {
+                    return v.empty() ? 0.0 : v[std::min(v.size() - 1, size_t(q * v.size()))] / 1e3;
+                };
+
+                char line[128];
+                snprintf(line, sizeof(line), "%-5s %-7s %7zu %8.1f %8.1f %8.1f %8.1f\n",
+                    names[ph], k ? "resolve" : "answer", v.size(), at(0.5), at(0.9), at(0.99),
+                    v.empty() ? 0.0 : v.back() / 1e3);
+                out << line;
+            }
+
+        out.flush();
+    }
+};
+
+Cmd_io &cmd_io(void) {
+    static Cmd_io c;
+    return c;
+}
@@ -0,0 +1,509 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cerrno>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <iterator>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "cache.hpp"
+#include "game.hpp"
+#include "results.hpp"
+
+// Simulation daemon. One process keeps the worker pool, the plugins and
+// policies it loaded and, with a cache dir, the result cache, and takes
+// jobs over a Unix domain socket, one request line per connection:
+//
+//   run [prio=0] [games=10000] [seed=0] [N=20,...] [k=3,...] [docs=1,...]
+//       [comas=1,...] [manas=1,...] [role=strategy]... [plugin=role:path]
+//       [policy=path] [early=1] [out=results_file]
+//   cancel ID
+//   jobs
+//   shutdown
+//
+// N, k, docs, comas and manas take lists, the job is their grid. run
+// answers "job ID" at once, then a line per grid point as it is done and
+// "done ID" or "cancelled ID". Jobs run by prio, the highest first, in
+// order of arrival within one, a block of cache_block_ seeds at a time: a
+// job of a higher prio takes over at the end of the block, the one it
+// stops goes back to the queue with what it has done. A client that goes
+// away cancels its job, running or queued, at the end of the block.
+// Each connection is read on a thread of its own, a silent or slow client
+// doesn't hold up the others.
+
+struct Daemon_job
+{
+    uint64_t id_{0};
+    int prio_{0};
+    uint64_t seq_{0};
+    std::vector<Config> grid_;
+    long long games_{10000};
+    uint64_t seed_{0};                 // a block start, so whole blocks hit the cache
+    std::unique_ptr<Results_writer> out_;
+    int fd_{-1};                       // the client
+    std::atomic<bool> cancel_{false};
+
+    // progress, of the dispatcher, point_ is read by jobs too
+    std::atomic<size_t> point_{0};
+    long long done_{0};
+    long long wins_[4] = {0, 0, 0, 0};
+    long long days_{0};
+
+    // false once the client is gone
+    bool reply(const std::string &line) {
+        if (fd_ < 0)
+            return false;
+        if (send(fd_, line.data(), line.size(), MSG_NOSIGNAL) != ssize_t(line.size())) {
+            close(fd_);
+            fd_ = -1;
+            return false;
+        }
+        return true;
+    }
+
+    // the client closed its end, seen without waiting
+    bool gone(void) {
+        char c;
+
+        if (fd_ < 0)
+            return true;
+        ssize_t n = recv(fd_, &c, 1, MSG_PEEK | MSG_DONTWAIT);
+        return n == 0 || (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK);
+    }
+
+    ~Daemon_job() {
+        if (fd_ >= 0)
+            close(fd_);
+    }
+};
+
+struct Daemon_order
+{
+    bool operator()(const std::shared_ptr<Daemon_job> &a, const std::shared_ptr<Daemon_job> &b) const {
+        return a->prio_ != b->prio_ ? a->prio_ > b->prio_ : a->seq_ < b->seq_;
+    }
+};
+
+class Daemon
+{
+    Pool pool_;
+    std::string path_;
+    std::string cache_dir_;
+    int listen_fd_{-1};
+
+    std::mutex mut_;
+    std::condition_variable cv_;
+    std::set<std::shared_ptr<Daemon_job>, Daemon_order> queue_;
+    std::shared_ptr<Daemon_job> running_;
+    std::map<std::string, std::shared_ptr<Policy>> policies_;
+    uint64_t next_id_{1};
+    bool stop_{false};
+    int handlers_{0};                  // connections being read, under mut_
+    std::condition_variable idle_;     // handlers_ dropped to 0
+
+    static std::vector<int> int_list(const std::string &s) {
+        std::vector<int> res;
+        std::istringstream in(s);
+        std::string x;
+
+        while (std::getline(in, x, ','))
+            res.push_back(atoi(x.c_str()));
+
+        return res;
+    }
+
+    // the job of a run line, or an error
+    std::string parse(std::istringstream &in, Daemon_job &job) {
+        static const std::map<std::string, int> roles = {
+            {"civilian", CIVILIAN}, {"doc", DOC}, {"coma", COMA}, {"mana", MANA}, {"mafia", MAFIA}};
+        std::vector<int> Ns = {20}, ks = {3}, docs = {1}, comas = {1}, manas = {1};
+        Config base{};
+        std::string w, out;
+
+        while (in >> w) {
+            size_t eq = w.find('=');
+            std::string key = w.substr(0, eq), val = eq == std::string::npos ? "" : w.substr(eq + 1);
+
+            if (key == "prio")
+                job.prio_ = atoi(val.c_str());
+            else if (key == "games")
+                job.games_ = atoll(val.c_str());
+            else if (key == "seed")
+                job.seed_ = strtoull(val.c_str(), nullptr, 10);
+            else if (key == "N")
+                Ns = int_list(val);
+            else if (key == "k")
+                ks = int_list(val);
+            else if (key == "docs")
+                docs = int_list(val);
+            else if (key == "comas")
+                comas = int_list(val);
+            else if (key == "manas")
+                manas = int_list(val);
+            else if (key == "early")
+                base.early_end_ = atoi(val.c_str());
+            else if (key == "out")
+                out = val;
+            else if (key == "policy") {
+                // loaded once for the life of the daemon
+                std::lock_guard<std::mutex> lg{mut_};
+                auto &pol = policies_[val];
+
+                if (!pol) {
+                    pol = std::make_shared<Policy>();
+                    if (!pol->load(val)) {
+                        policies_.erase(val);
+                        return "can't load the policy " + val;
+                    }
+                }
+                base.policy_ = pol;
+            } else if (key == "plugin" && val.find(':') != std::string::npos) {
+                std::string who = val.substr(0, val.find(':'));
+                auto plugin = Plugin::load(val.substr(val.find(':') + 1));
+
+                if (!plugin || !roles.count(who))
+                    return "bad plugin " + val;
+                base.plugin_[roles.at(who)] = plugin;
+            } else if (roles.count(key) && name_to_strategy.count(val))
+                base.strategy_[roles.at(key)] = name_to_strategy[val];
+            else
+                return "unknown " + w;
+        }
+
+        for (int N : Ns)
+            for (int k : ks)
+                for (int d : docs)
+                    for (int c : comas)
+                        for (int m : manas) {
+                            Config conf = base;
+
+                            conf.N_ = N;
+                            conf.mafia_count_ = k >= 3 ? N / k : 0;
+                            conf.doc_count_ = d;
+                            conf.coma_count_ = c;
+                            conf.mana_count_ = m;
+
+                            if (!conf.valid())
+                                return "no game for N " + std::to_string(N) + " k " + std::to_string(k);
+                            build_forced(conf);
+                            job.grid_.push_back(conf);
+                        }
+
+        if (job.games_ <= 0)
+            return "no games";
+
+        if (!out.empty()) {
+            job.out_ = std::make_unique<Results_writer>(out);
+            if (!job.out_->good())
+                return "can't write " + out;
+        }
+
+        return "";
+    }
+
+    // one block of seeds of the current point of job; true once the job is done
+    bool step(Daemon_job &job) {
+        const Config &conf = job.grid_[job.point_];
+        uint64_t at = job.seed_ + job.done_;
+        uint64_t end = job.seed_ + job.games_;
+        uint64_t stop = std::min(end, (at / cache_block_ + 1) * cache_block_);
+
+        if (!cache_dir_.empty() && !job.out_) {
+            Cache_res r = cached_games(pool_, cache_dir_, conf, stop - at, at);
+
+            for (int i = 0; i < 4; ++i)
+                job.wins_[i] += r.wins_[i];
+            job.days_ += r.days_;
+        } else {
+            std::atomic<long long> wins[4] = {0, 0, 0, 0}, days{0};
+
+            play_games(pool_, stop - at, conf, 0, at, [&](Game *gm, double) {
+                if (job.out_)
+                    job.out_->add(gm->rec());
+                wins[gm->res()].fetch_add(1, std::memory_order_relaxed);
+                days.fetch_add(gm->days(), std::memory_order_relaxed);
+            });
+
+            for (int i = 0; i < 4; ++i)
+                job.wins_[i] += wins[i];
+            job.days_ += days;
+        }
+
+        job.done_ += stop - at;
+        if (job.done_ < job.games_)
+            return false;
+
+        char line[256];
+        snprintf(line, sizeof(line), "N %d mafia %d docs %d comas %d manas %d games %lld"
+            " civilian %lld mafia %lld mana %lld days %.4f\n",
+            conf.N_, conf.mafia_count_, conf.doc_count_, conf.coma_count_, conf.mana_count_, job.games_,
+            job.wins_[1], job.wins_[2], job.wins_[3], double(job.days_) / job.games_);
+        if (!job.reply(line))
+            job.cancel_ = true;
+
+        job.done_ = 0;
+        job.days_ = 0;
+        std::fill(job.wins_, job.wins_ + 4, 0);
+
+        return ++job.point_ == job.grid_.size();
+    }
+
+    // the queued jobs whose clients went away, under mut_
+    void drop_gone(void) {
+        for (auto it = queue_.begin(); it != queue_.end();)
+            it = (*it)->gone() ? queue_.erase(it) : std::next(it);
+    }
+
+    void dispatch_loop(void) {
+        tracer().name_thread("dispatcher");
+
+        while (true) {
+            std::unique_lock<std::mutex> ul{mut_};
+            cv_.wait(ul, [this] { return stop_ || !queue_.empty(); });
+
+            if (stop_)
+                break;
+
+            running_ = *queue_.begin();
+            queue_.erase(queue_.begin());
+            auto job = running_;
+            ul.unlock();
+
+            bool done = false, preempted = false;
+            while (!job->cancel_ && !done) {
+                if (job->gone()) {
+                    job->cancel_ = true;
+                    break;
+                }
+                done = step(*job);
+
+                std::lock_guard<std::mutex> lg{mut_};
+                if (stop_)
+                    break;
+                drop_gone();
+                // once back in the queue the job belongs to it, a cancel may answer for it at once
+                if (!done && !queue_.empty() && (*queue_.begin())->prio_ > job->prio_) {
+                    queue_.insert(job);
+                    running_.reset();
+                    preempted = true;
+                    break;
+                }
+            }
+
+            if (preempted)
+                continue;
+
+            ul.lock();
+            running_.reset();
+            ul.unlock();
+
+            if (job->out_)
+                job->out_->close();
+            job->reply((done ? "done " : "cancelled ") + std::to_string(job->id_) + "\n");
+        }
+
+        // what is left when shut down
+        std::lock_guard<std::mutex> lg{mut_};
+        for (auto &job : queue_)
+            job->reply("cancelled " + std::to_string(job->id_) + "\n");
+        queue_.clear();
+    }
+
+    void handle(const int &fd) {
+        std::string line;
+        char buf[1024];
+
+        // one line, the client waits for the answer
+        while (line.find('\n') == std::string::npos && line.size() < 65536) {
+            ssize_t n = recv(fd, buf, sizeof(buf), 0);
+            if (n <= 0)
+                break;
+            line.append(buf, n);
+        }
+
+        std::istringstream in(line.substr(0, line.find('\n')));
+        std::string cmd;
+        in >> cmd;
+
+        auto answer = [&](const std::string &s) {
+            send(fd, s.data(), s.size(), MSG_NOSIGNAL);
+            close(fd);
+        };
+
+        if (cmd == "run") {
+            auto job = std::make_shared<Daemon_job>();
+            std::string err = parse(in, *job);
+
+            if (!err.empty())
+                return answer("error " + err + "\n");
+
+            std::lock_guard<std::mutex> lg{mut_};
+            if (stop_)
+                return answer("error shutting down\n");
+            job->id_ = next_id_++;
+            job->seq_ = job->id_;
+            job->fd_ = fd;
+            job->reply("job " + std::to_string(job->id_) + "\n");
+            queue_.insert(job);
+            cv_.notify_one();
+        } else if (cmd == "cancel") {
+            uint64_t id = 0;
+            in >> id;
+
+            std::unique_lock<std::mutex> ul{mut_};
+            for (auto it = queue_.begin(); it != queue_.end(); ++it)
+                if ((*it)->id_ == id) {
+                    (*it)->reply("cancelled " + std::to_string(id) + "\n");
+                    queue_.erase(it);
+                    ul.unlock();
+                    return answer("ok\n");
+                }
+
+            if (running_ && running_->id_ == id) {
+                running_->cancel_ = true;
+                ul.unlock();
+                return answer("ok\n");
+            }
+            ul.unlock();
+            answer("error no job " + std::to_string(id) + "\n");
+        } else if (cmd == "jobs") {
+            std::ostringstream out;
+            std::lock_guard<std::mutex> lg{mut_};
+
+            if (running_)
+                out << running_->id_ << " prio " << running_->prio_ << " running, point "
+                    << running_->point_ + 1 << "/" << running_->grid_.size() << "\n";
+            for (auto &job : queue_)
+                out << job->id_ << " prio " << job->prio_ << " queued, point "
+                    << job->point_ + 1 << "/" << job->grid_.size() << "\n";
+            answer(out.str());
+        } else if (cmd == "shutdown") {
+            {
+                std::lock_guard<std::mutex> lg{mut_};
+                stop_ = true;
+            }
+            cv_.notify_all();
+            ::shutdown(listen_fd_, SHUT_RDWR);
+            answer("ok\n");
+        } else {
+            answer("error unknown " + cmd + "\n");
+        }
+    }
+
+public:
+    Daemon (const std::string &path, const int &threads = 0, const std::string &cache_dir = "") :
+        pool_(threads),
+        path_(path),
+        cache_dir_(cache_dir)
+    {}
+
+    Daemon (const Daemon &) = delete;
+    Daemon &operator=(const Daemon &) = delete;
+
+    // serves until shutdown, false if the socket can't be had
+    bool run(void) {
+        sockaddr_un addr{};
+        addr.sun_family = AF_UNIX;
+
+        if (path_.size() >= sizeof(addr.sun_path)) {
+            std::cout << "Socket path too long " << path_ << "\n";
+            return false;
+        }
+        strcpy(addr.sun_path, path_.c_str());
+        unlink(path_.c_str());
+
+        listen_fd_ = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (listen_fd_ < 0 || bind(listen_fd_, (sockaddr *)&addr, sizeof(addr)) || listen(listen_fd_, 64)) {
+            std::cout << "Can't listen on " << path_ << ": " << strerror(errno) << "\n";
+            return false;
+        }
+
+        std::cout << "Serving on " << path_ << ", " << pool_.size() << " threads"
+            << (cache_dir_.empty() ? "" : ", cache " + cache_dir_) << "\n";
+        std::cout.flush();
+
+        std::thread dispatcher{&Daemon::dispatch_loop, this};
+
+        while (true) {
+            int fd = accept(listen_fd_, nullptr, nullptr);
+
+            if (fd < 0) {
+                std::lock_guard<std::mutex> lg{mut_};
+                if (stop_)
+                    break;
+                continue;
+            }
+
+            // a client that connects and sends nothing lets its thread go
+            timeval tv{2, 0};
+            setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+
+            {
+                std::lock_guard<std::mutex> lg{mut_};
+                ++handlers_;
+            }
+            std::thread([this, fd] {
+                handle(fd);
+                std::lock_guard<std::mutex> lg{mut_};
+                if (--handlers_ == 0)
+                    idle_.notify_all();
+            }).detach();
+        }
+
+        dispatcher.join();
+        {
+            // the handlers still reading touch this object
+            std::unique_lock<std::mutex> ul{mut_};
+            idle_.wait(ul, [this] { return handlers_ == 0; });
+        }
+        close(listen_fd_);
+        unlink(path_.c_str());
+
+        return true;
+    }
+};
+
+// sends one request to the daemon at path and prints the answer as it
+// comes; false if there is no daemon
+bool daemon_ask(const std::string &path, const std::string &request) {
+    sockaddr_un addr{};
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path, path.c_str(), sizeof(addr.sun_path) - 1);
+
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0 || connect(fd, (sockaddr *)&addr, sizeof(addr))) {
+        std::cout << "No daemon on " << path << "\n";
+        if (fd >= 0)
+            close(fd);
+        return false;
+    }
+
+    std::string line = request + "\n";
+    send(fd, line.data(), line.size(), MSG_NOSIGNAL);
+
+    char buf[4096];
+    ssize_t n;
+    while ((n = recv(fd, buf, sizeof(buf), 0)) > 0) {
+        std::cout.write(buf, n);
+        std::cout.flush();
+    }
+
+    close(fd);
+    return true;
+}
@@ -0,0 +1,161 @@
+#pragma once
+
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <iostream>
+#include <vector>
+
+#include "game.hpp"
+
+// A/B duel of two configurations, usually the same lobby with one role on
+// another strategy. Both play the same seeds with Config::crn_, so game i
+// of A and game i of B are dealt the same roles and every seat draws the
+// same numbers in the same phase, and the test runs on the paired
+// differences d_i = win_B(i) - win_A(i) of the side that is watched.
+// Above game_grain_ seats a game isn't the same twice, the pairs share
+// the deal only.
+//
+// After every batch a sequential probability ratio test (normal
+// approximation of the mean of d) is done for H0: mean 0 against
+// H+: mean +delta and H-: mean -delta. It stops once one of them is
+// accepted at error rates alpha and beta, or after max_games pairs.
+
+enum Duel_res
+{
+    DUEL_OPEN,   // max_games reached
+    DUEL_SAME,   // H0
+    DUEL_BETTER, // H+, B wins more often
+    DUEL_WORSE,  // H-
+};
+
+struct Duel_stats
+{
+    long long n_{0};
+    long long win_a_{0};
+    long long win_b_{0};
+    double sum_{0};
+    double sum2_{0};
+
+    void add(const int &a, const int &b) {
+        int d = b - a;
+
+        ++n_;
+        win_a_ += a;
+        win_b_ += b;
+        sum_ += d;
+        sum2_ += d * d;
+    }
+
+    double mean(void) const {
+        return n_ ? sum_ / n_ : 0;
+    }
+
+    // of one d
+    double var(void) const {
+        return n_ > 1 ? (sum2_ - sum_ * sum_ / n_) / (n_ - 1) : 0;
+    }
+
+    // log likelihood ratio of mean theta against mean 0
+    double llr(const double &theta) const {
+        double var = this->var();
+        if (var < 1e-9)
+            var = 1e-9;
+
+        return n_ / var * (theta * mean() - theta * theta / 2);
+    }
+};
+
+// the wins of the side in a and in b on seeds [seed, seed + games)
+void play_pairs(Pool &pool,
+    const Config &a,
+    const Config &b,
+    const int &side,
+    const long long &games,
+    const uint64_t &seed,
+    Duel_stats &st)
+{
+    std::vector<int8_t> win_a(games, 0), win_b(games, 0);
+
+    // every game writes its own slot, no lock needed
+    play_games(pool, games, a, 0, seed, [&](Game *gm, double) {
+        win_a[gm->rec().seed_ - seed] = gm->res() == side;
+    });
+    play_games(pool, games, b, 0, seed, [&](Game *gm, double) {
+        win_b[gm->rec().seed_ - seed] = gm->res() == side;
+    });
+
+    for (long long i = 0; i < games; ++i)
+        st.add(win_a[i], win_b[i]);
+}
+
+int run_duel(Pool &pool,
+    Config a,
+    Config b,
+    const int &side, // winner that counts, 1 - civ, 2 - maf, 3 - man
+    const double &delta,
+    const long long &max_games,
+    const uint64_t &seed,
+    const double &alpha = 0.05,
+    const double &beta = 0.05,
+    const long long &batch = 1000)
+{
+    using clock = std::chrono::steady_clock;
+
+    double upper = std::log((1 - beta) / alpha);
+    double lower = std::log(beta / (1 - alpha));
+
+    Duel_stats st;
+    int res = DUEL_OPEN;
+
+    a.crn_ = b.crn_ = a.N_ <= game_grain_;
+
+    auto begin = clock::now();
+
+    if (!a.crn_)
+        std::cout << "N over " << game_grain_ << ", the pairs share the deal only\n";
+    std::cout << "Duel on seed " << seed << ", delta " << delta << ", alpha " << alpha
+        << ", beta " << beta << ", bounds " << lower << " " << upper << "\n";
+    std::cout.flush();
+
+    for (long long from = 0; from < max_games && res == DUEL_OPEN; from += batch) {
+        play_pairs(pool, a, b, side, std::min(batch, max_games - from), seed + from, st);
+
+        double up = st.llr(delta);
+        double down = st.llr(-delta);
+
+        if (up >= upper)
+            res = DUEL_BETTER;
+        else if (down >= upper)
+            res = DUEL_WORSE;
+        else if (up <= lower && down <= lower)
+            res = DUEL_SAME;
+
+        std::cout << "Pairs " << st.n_ << ": A " << double(st.win_a_) / st.n_
+            << " B " << double(st.win_b_) / st.n_ << " diff " << st.mean()
+            << ", llr+ " << up << " llr- " << down << "\n";
+        std::cout.flush();
+    }
+
+    double sec = std::chrono::duration<double>(clock::now() - begin).count();
+
+    switch (res) {
+        case DUEL_OPEN:
+            std::cout << "Not settled after " << st.n_ << " pairs\n";
+            break;
+        case DUEL_SAME:
+            std::cout << "No change of " << delta << " or more\n";
+            break;
+        case DUEL_BETTER:
+            std::cout << "B wins more often\n";
+            break;
+        case DUEL_WORSE:
+            std::cout << "B wins less often\n";
+            break;
+    }
+
+    std::cout << "Time " << sec << " s, " << 2 * st.n_ / sec << " games/s\n";
+    std::cout.flush();
+
+    return res;
+}
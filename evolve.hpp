@@ -0,0 +1,148 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <iostream>
+#include <vector>
+
+#include "game.hpp"
+
+// Evolution of Bot_params for one team, civilians (Civilian, Doc, Coma) or
+// mafia, by a (mu + lambda) strategy with Gaussian mutation and uniform
+// crossover. Every generation all candidates play the same fresh block of
+// seeds, so they are compared on the same deals, and survivors keep the
+// games of earlier generations: their win rate gets sharper the longer
+// they live instead of being played again from zero.
+
+struct Evo_cand
+{
+    Bot_params params_;
+    long long wins_{0};
+    long long games_{0};
+
+    double rate(void) const {
+        return games_ ? double(wins_) / games_ : 0;
+    }
+
+    // one standard error down, so a lucky newcomer doesn't push out a
+    // survivor known better
+    double score(void) const {
+        return games_ ? rate() - std::sqrt(rate() * (1 - rate()) / games_) : 0;
+    }
+};
+
+// plays games of conf with params on seeds [seed, seed + games), the wins
+// of `side`
+long long evo_play(Pool &pool, Config conf, const Bot_params &params, const int &side,
+    const long long &games, const uint64_t &seed)
+{
+    std::atomic<long long> wins{0};
+
+    conf.params_ = params;
+    play_games(pool, games, conf, 0, seed, [&](Game *gm, double) {
+        if (gm->res() == side)
+            wins.fetch_add(1, std::memory_order_relaxed);
+    });
+
+    return wins.load();
+}
+
+void print_params(const Bot_params &p) {
+    for (int i = 0; i < Bot_params::size_; ++i)
+        std::cout << " " << bot_param_names[i] << "=" << p[i];
+}
+
+// team - MAFIA or CIVILIAN; budget - games in all
+Bot_params run_evolve(Pool &pool,
+    Config conf,
+    const int &team,
+    const long long &budget,
+    const uint64_t &seed,
+    const int &mu = 4,
+    const int &lambda = 12,
+    const long long &batch = 2000)
+{
+    using clock = std::chrono::steady_clock;
+
+    int side = team == MAFIA ? 2 : 1;
+    Rng g(seed, ~uint64_t(0));
+
+    if (team == MAFIA) {
+        conf.strategy_[MAFIA] = STRAT_TUNED;
+    } else {
+        conf.strategy_[CIVILIAN] = STRAT_TUNED;
+        conf.strategy_[DOC] = STRAT_TUNED;
+        conf.strategy_[COMA] = STRAT_TUNED;
+    }
+
+    // the base bots start, the rest at random
+    std::vector<Evo_cand> pop(mu + lambda);
+    for (size_t c = 1; c < pop.size(); ++c)
+        for (int i = 0; i < Bot_params::size_; ++i)
+            pop[c].params_.p_[i] = g.uniform();
+
+    long long spent = 0;
+    long long base_wins = 0, base_games = 0;
+    uint64_t block = seed;
+    double sigma = 0.2;
+
+    auto begin = clock::now();
+
+    for (int gen = 0; spent + (long long)(pop.size() + 1) * batch <= budget; ++gen) {
+        for (auto &c : pop) {
+            c.wins_ += evo_play(pool, conf, c.params_, side, batch, block);
+            c.games_ += batch;
+        }
+
+        // the untouched base bots on the same seeds, for reference
+        Config base = conf;
+        std::fill(base.strategy_, base.strategy_ + MAFIA + 1, STRAT_BASE);
+        base_wins += evo_play(pool, base, Bot_params(), side, batch, block);
+        base_games += batch;
+
+        spent += (pop.size() + 1) * batch;
+        block += batch;
+
+        std::sort(pop.begin(), pop.end(), [](const Evo_cand &a, const Evo_cand &b) {
+            return a.score() > b.score();
+        });
+
+        std::cout << "Generation " << gen << ", games " << spent << ": best " << pop[0].rate()
+            << " over " << pop[0].games_ << " games, base " << double(base_wins) / base_games << ",";
+        print_params(pop[0].params_);
+        std::cout << "\n";
+        std::cout.flush();
+
+        // children of the mu best
+        for (int c = mu; c < mu + lambda; ++c) {
+            const Bot_params &a = pop[g.randint(0, mu - 1)].params_;
+            const Bot_params &b = pop[g.randint(0, mu - 1)].params_;
+            Evo_cand child;
+
+            for (int i = 0; i < Bot_params::size_; ++i) {
+                // Box-Muller
+                double n = std::sqrt(-2 * std::log(1 - g.uniform())) * std::cos(2 * M_PI * g.uniform());
+                double v = (g.randint(0, 1) ? a : b)[i] + sigma * n;
+                child.params_.p_[i] = std::clamp(v, 0.0, 1.0);
+            }
+
+            pop[c] = child;
+        }
+
+        sigma = std::max(0.03, sigma * 0.9);
+    }
+
+    double sec = std::chrono::duration<double>(clock::now() - begin).count();
+
+    std::cout << "Best win rate " << pop[0].rate() << " over " << pop[0].games_ << " games, base "
+        << (base_games ? double(base_wins) / base_games : 0) << ", " << spent << " games in "
+        << sec << " s\n";
+    std::cout << "Params";
+    print_params(pop[0].params_);
+    std::cout << "\n";
+    std::cout.flush();
+
+    return pop[0].params_;
+}
@@ -0,0 +1,344 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Live feed of game events in a POSIX shared memory ring. The hosts write
+// every event once, any number of observer processes map the ring read
+// only and follow it at their own pace. Writers never wait for readers: a
+// reader that falls more than a ring behind finds newer sequence numbers
+// in its slots and skips ahead, counting what it lost.
+//
+// Slot s % size_ holds event s. Its ver_ is 2s + 1 while it is written and
+// 2s + 2 once done, a reader takes the words in place and checks ver_
+// again afterwards, like a seqlock. Enabled with MAFIA_FEED=name.
+
+enum Feed_kind
+{
+    FEED_NIGHT,   // a: day
+    FEED_KILL,    // a: killer (MANA, COMA, MAFIA, VOTE), b: victim
+    FEED_SAVE,    // b: saved seat
+    FEED_NO_KICK,
+    FEED_END,     // a: winner
+};
+
+struct Feed_event
+{
+    uint64_t game_;   // seed
+    int32_t day_;
+    int32_t kind_;
+    int32_t a_;
+    int32_t b_;
+};
+
+struct Feed_slot
+{
+    std::atomic<uint64_t> ver_;
+    std::atomic<uint64_t> w_[3];
+};
+
+struct Feed_head
+{
+    alignas(8) char magic_[8];
+    uint64_t size_;                 // slots, power of two
+    alignas(64) std::atomic<uint64_t> next_;
+    alignas(64) std::atomic<uint64_t> lost_;  // by writers lapped while waiting
+};
+
+static_assert(std::atomic<uint64_t>::is_always_lock_free, "the feed needs lock free atomics");
+
+// "MFEED01" as one word; the writer that makes the ring stores it last
+const uint64_t feed_magic_ = [] {
+    uint64_t m;
+    std::memcpy(&m, "MFEED01", 8);
+    return m;
+}();
+
+inline std::atomic_ref<uint64_t> feed_magic(Feed_head *h) {
+    return std::atomic_ref<uint64_t>(*reinterpret_cast<uint64_t *>(h->magic_));
+}
+
+inline Feed_slot *feed_slots(Feed_head *h) {
+    return reinterpret_cast<Feed_slot *>(h + 1);
+}
+
+class Feed_writer
+{
+    static const int spin_max_ = 256;   // yields for a slot still being written
+
+    std::atomic<bool> on_{false};
+    Feed_head *head_{nullptr};
+    size_t bytes_{0};
+
+public:
+    bool on(void) const {
+        return on_.load(std::memory_order_relaxed);
+    }
+
+    // joins the ring of that name or makes it, size is for a new one; the
+    // sequence goes on over runs, so readers can outlive the writers
+    bool open(const std::string &name, size_t size = 1 << 16) {
+        size_t s = 1;
+        while (s < size)
+            s <<= 1;
+
+        bool fresh = true;
+        int fd = shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0644);
+        struct stat st;
+
+        if (fd < 0) {
+            fresh = false;
+            fd = shm_open(name.c_str(), O_RDWR, 0);
+        }
+        if (fd < 0)
+            return false;
+
+        if (fresh && ftruncate(fd, sizeof(Feed_head) + s * sizeof(Feed_slot))) {
+            close(fd);
+            return false;
+        }
+
+        // a new ring may still be growing in another writer, or not have
+        // its magic yet; it shows up in a few ms or never
+        void *p = MAP_FAILED;
+        bool ready = false;
+
+        for (int i = 0; i < 100; ++i) {
+            if (p == MAP_FAILED && !fstat(fd, &st) && size_t(st.st_size) >= sizeof(Feed_head)) {
+                bytes_ = st.st_size;
+                p = mmap(nullptr, bytes_, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+                if (p == MAP_FAILED)
+                    break;
+            }
+            if (p != MAP_FAILED && (fresh || feed_magic(static_cast<Feed_head *>(p)).load() == feed_magic_)) {
+                ready = true;
+                break;
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        close(fd);
+
+        if (p == MAP_FAILED)
+            return false;
+
+        head_ = static_cast<Feed_head *>(p);
+
+        // the zeroed mapping is the empty ring, ver_ 0 is older than any event
+        if (fresh) {
+            head_->size_ = s;
+            feed_magic(head_).store(feed_magic_);
+        }
+
+        if (!ready || bytes_ != sizeof(Feed_head) + head_->size_ * sizeof(Feed_slot)) {
+            munmap(head_, bytes_);
+            head_ = nullptr;
+            return false;
+        }
+
+        on_.store(true);
+
+        return true;
+    }
+
+    // any thread, usually the host of the game
+    void publish(const Feed_event &e) {
+        uint64_t s = head_->next_.fetch_add(1, std::memory_order_relaxed);
+        Feed_slot &slot = feed_slots(head_)[s & (head_->size_ - 1)];
+        uint64_t v = slot.ver_.load(std::memory_order_acquire);
+
+        // the writer a lap ago may still be in the slot. One from an older
+        // lap died in it, a crashed run, and is written over; the one a
+        // lap ago is waited for a while, then the event is lost.
+        uint64_t stale = s >= head_->size_ ? 2 * (s - head_->size_) + 1 : 0;
+
+        for (int spins = 0;; ++spins) {
+            if (v >= 2 * s + 1 || ((v & 1) && v >= stale && spins >= spin_max_)) {
+                head_->lost_.fetch_add(1, std::memory_order_relaxed);
+                return;
+            }
+
+            if ((v & 1) && v >= stale) {
+                std::this_thread::yield();
+                v = slot.ver_.load(std::memory_order_acquire);
+                continue;
+            }
+
+            if (slot.ver_.compare_exchange_weak(v, 2 * s + 1, std::memory_order_acquire))
+                break;
+        }
+
+        std::atomic_thread_fence(std::memory_order_release);
+        slot.w_[0].store(e.game_, std::memory_order_relaxed);
+        slot.w_[1].store(uint64_t(uint32_t(e.day_)) << 32 | uint32_t(e.kind_), std::memory_order_relaxed);
+        slot.w_[2].store(uint64_t(uint32_t(e.a_)) << 32 | uint32_t(e.b_), std::memory_order_relaxed);
+        slot.ver_.store(2 * s + 2, std::memory_order_release);
+    }
+
+    ~Feed_writer() {
+        if (head_)
+            munmap(head_, bytes_);
+    }
+};
+
+Feed_writer &feed(void) {
+    static Feed_writer f;
+    return f;
+}
+
+inline void feed_event(const uint64_t &game, const int &day, const int &kind, const int &a = -1, const int &b = -1) {
+    if (feed().on())
+        feed().publish({game, day, kind, a, b});
+}
+
+class Feed_reader
+{
+    Feed_head *head_{nullptr};
+    size_t bytes_{0};
+    uint64_t next_{0};
+
+public:
+    // from the next event on, or from the oldest one still in the ring
+    Feed_reader (const std::string &name, const bool &from_oldest = false) {
+        int fd = shm_open(name.c_str(), O_RDONLY, 0);
+        struct stat st;
+
+        if (fd < 0)
+            return;
+
+        void *p = MAP_FAILED;
+        if (!fstat(fd, &st) && size_t(st.st_size) >= sizeof(Feed_head)) {
+            bytes_ = st.st_size;
+            p = mmap(nullptr, bytes_, PROT_READ, MAP_SHARED, fd, 0);
+        }
+        close(fd);
+
+        if (p == MAP_FAILED || feed_magic(static_cast<Feed_head *>(p)).load() != feed_magic_) {
+            if (p != MAP_FAILED)
+                munmap(p, bytes_);
+            return;
+        }
+
+        head_ = static_cast<Feed_head *>(p);
+        next_ = head_->next_.load(std::memory_order_acquire);
+        if (from_oldest)
+            next_ = next_ > head_->size_ ? next_ - head_->size_ : 0;
+    }
+
+    Feed_reader (const Feed_reader &) = delete;
+    Feed_reader &operator=(const Feed_reader &) = delete;
+
+    bool good(void) const {
+        return head_;
+    }
+
+    // 1 - e is the next event, 0 - none yet; lost gets the events skipped
+    int next(Feed_event &e, uint64_t &lost) {
+        const Feed_slot &slot = feed_slots(head_)[next_ & (head_->size_ - 1)];
+        uint64_t v = slot.ver_.load(std::memory_order_acquire);
+
+        lost = 0;
+
+        if (v == 2 * next_ + 2) {
+            uint64_t w0 = slot.w_[0].load(std::memory_order_relaxed);
+            uint64_t w1 = slot.w_[1].load(std::memory_order_relaxed);
+            uint64_t w2 = slot.w_[2].load(std::memory_order_relaxed);
+
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (slot.ver_.load(std::memory_order_relaxed) == v) {
+                e = {w0, int32_t(w1 >> 32), int32_t(uint32_t(w1)), int32_t(w2 >> 32), int32_t(uint32_t(w2))};
+                ++next_;
+                return 1;
+            }
+        } else if (v < 2 * next_ + 2) {
+            return 0; // not written yet
+        }
+
+        // overrun, go on from the oldest event that is surely still there
+        uint64_t head = head_->next_.load(std::memory_order_acquire);
+        uint64_t from = head > head_->size_ / 2 ? head - head_->size_ / 2 : 0;
+
+        lost = from > next_ ? from - next_ : 1;
+        next_ = std::max(from, next_ + 1);
+        return 0;
+    }
+
+    uint64_t writer_lost(void) const {
+        return head_->lost_.load(std::memory_order_relaxed);
+    }
+
+    ~Feed_reader() {
+        if (head_)
+            munmap(head_, bytes_);
+    }
+};
+
+// prints the feed until killed, waits for it if there is none yet; games = 0 prints every event, else a line
+// per `games` games ended
+void watch_feed(const std::string &name, const long long &games = 0) {
+    std::unique_ptr<Feed_reader> rp;
+
+    // the feed comes with the first writer
+    while (!(rp = std::make_unique<Feed_reader>(name))->good())
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+
+    Feed_reader &r = *rp;
+
+    const char *killer[] = {"", "", "Coma", "Mana", "Mafia", "Vote"};
+    long long ended = 0, wins[4] = {0, 0, 0, 0}, lost_all = 0;
+
+    while (true) {
+        Feed_event e;
+        uint64_t lost;
+
+        if (!r.next(e, lost)) {
+            if (lost) {
+                lost_all += lost;
+                std::cout << "Lost " << lost << " events\n";
+            } else {
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            }
+            continue;
+        }
+
+        if (games > 0) {
+            if (e.kind_ == FEED_END && e.a_ >= 0 && e.a_ < 4) {
+                ++wins[e.a_];
+                if (++ended % games == 0)
+                    std::cout << "Games " << ended << ", civ " << wins[1] << " maf " << wins[2]
+                        << " mana " << wins[3] << ", lost events " << lost_all << std::endl;
+            }
+            continue;
+        }
+
+        std::cout << "game " << e.game_ << " day " << e.day_ << ": ";
+        switch (e.kind_) {
+            case FEED_NIGHT:
+                std::cout << "night";
+                break;
+            case FEED_KILL:
+                std::cout << killer[e.a_] << " kill " << e.b_;
+                break;
+            case FEED_SAVE:
+                std::cout << "Doc save " << e.b_;
+                break;
+            case FEED_NO_KICK:
+                std::cout << "no kick";
+                break;
+            case FEED_END:
+                std::cout << "end, winner " << e.a_;
+                break;
+        }
+        std::cout << std::endl;
+    }
+}
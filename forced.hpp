@@ -0,0 +1,174 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <tuple>
+#include <vector>
+
+// The winners a position can still end with, whatever anyone does, by the
+// live counts only: mafia, civilians, docs, comas, manas and whether the
+// night or the vote comes next. A position with a single one is decided.
+//
+// The moves are a superset of what the bots do, so a position marked
+// decided is decided. At night the mafia kill one non mafia, every mana
+// kills a seat, every coma kills a seat or checks, every doc saves a seat;
+// who by class dies is any split of the kills that isn't ruled out by the
+// counts, the saves can undo any of them. At the vote any one seat or
+// none is kicked. Counts only go down, so the table is filled by growing
+// total, with a fixpoint between the night and the vote of the same counts.
+//
+// That the mafia and mana kills always land is true of the built-in bots
+// only: a plugin may name no one and a human may be scripted, so games
+// with either don't end early (see build_forced).
+
+enum Forced_phase
+{
+    FORCED_NIGHT,
+    FORCED_VOTE,
+};
+
+class Forced_table
+{
+    int M_, C_, D_, K_, A_;
+    std::vector<uint8_t> win_;   // bits 1 << winner, by position
+
+    size_t at(const int &m, const int &c, const int &d, const int &k, const int &a, const int &ph) const {
+        return ((((size_t(m) * (C_ + 1) + c) * (D_ + 1) + d) * (K_ + 1) + k) * (A_ + 1) + a) * 2 + ph;
+    }
+
+public:
+    // as Host::state_game, 0 - go on
+    static int state(const int &m, const int &c, const int &d, const int &k, const int &a) {
+        int all_civ = c + d + k + a;
+
+        if (m > all_civ)
+            return 2;
+        if (m == all_civ)
+            return a ? 0 : 2;
+        if (!m)
+            return a ? 3 : 1;
+        return 0;
+    }
+
+    // positions, the largest lobby a table is made for
+    static const size_t max_size_ = size_t(1) << 22;
+
+    static size_t size(const int &M, const int &C, const int &D, const int &K, const int &A) {
+        return size_t(M + 1) * (C + 1) * (D + 1) * (K + 1) * (A + 1) * 2;
+    }
+
+    // night outcomes looked at, by work(), the most a table is built with
+    static const size_t max_work_ = size_t(1) << 32;   // about a second
+
+    // the night outcomes of the full position times the positions, an
+    // upper bound of the work of a fixpoint round
+    static size_t work(const int &M, const int &C, const int &D, const int &K, const int &A) {
+        int kills = (M > 0) + A + K;
+        int caps[] = {std::min(M, A + K), C, D, K, A};
+        std::vector<double> ways(kills + 1, 0);   // splits by deaths so far
+        ways[0] = 1;
+
+        for (int cap : caps) {
+            std::vector<double> next(kills + 1, 0);
+            for (int s = 0; s <= kills; ++s)
+                for (int v = 0; v <= cap && s + v <= kills; ++v)
+                    next[s + v] += ways[s];
+            ways = next;
+        }
+
+        double n = 0;
+        for (double w : ways)
+            n += w;
+
+        return size_t(std::min(n * size(M, C, D, K, A), double(max_work_) * 2));
+    }
+
+    Forced_table (const int &M, const int &C, const int &D, const int &K, const int &A) :
+        M_(M), C_(C), D_(D), K_(K), A_(A),
+        win_(size(M, C, D, K, A), 0)
+    {
+        // the winners after the counts become these and then ph comes
+        auto reach = [&](const int &m, const int &c, const int &d, const int &k, const int &a, const int &ph) {
+            int s = state(m, c, d, k, a);
+            return s ? uint8_t(1 << s) : win_[at(m, c, d, k, a, ph)];
+        };
+
+        for (int total = 0; total <= M + C + D + K + A; ++total) {
+            std::vector<std::tuple<int, int, int, int, int>> level;
+
+            for (int m = 0; m <= std::min(M, total); ++m)
+                for (int c = 0; c <= std::min(C, total - m); ++c)
+                    for (int d = 0; d <= std::min(D, total - m - c); ++d)
+                        for (int k = 0; k <= std::min(K, total - m - c - d); ++k) {
+                            int a = total - m - c - d - k;
+                            if (a <= A && !state(m, c, d, k, a))
+                                level.emplace_back(m, c, d, k, a);
+                        }
+
+            // only "nobody dies" stays on the level, a few rounds settle it
+            for (bool changed = true; changed;) {
+                changed = false;
+
+                for (auto [m, c, d, k, a] : level) {
+                    uint8_t night = 0, vote = reach(m, c, d, k, a, FORCED_NIGHT);
+
+                    if (m) vote |= reach(m - 1, c, d, k, a, FORCED_NIGHT);
+                    if (c) vote |= reach(m, c - 1, d, k, a, FORCED_NIGHT);
+                    if (d) vote |= reach(m, c, d - 1, k, a, FORCED_NIGHT);
+                    if (k) vote |= reach(m, c, d, k - 1, a, FORCED_NIGHT);
+                    if (a) vote |= reach(m, c, d, k, a - 1, FORCED_NIGHT);
+
+                    // deaths by class; at most one kill per killer, mafia only
+                    // by mana and coma, and with no doc the mafia kill lands
+                    int kills = (m > 0) + a + k;
+                    for (int vm = 0; vm <= std::min({m, a + k, kills}); ++vm)
+                        for (int vc = 0; vc <= std::min(c, kills - vm); ++vc)
+                            for (int vd = 0; vd <= std::min(d, kills - vm - vc); ++vd)
+                                for (int vk = 0; vk <= std::min(k, kills - vm - vc - vd); ++vk)
+                                    for (int va = 0; va <= std::min(a, kills - vm - vc - vd - vk); ++va) {
+                                        if (!d && m && !(vc + vd + vk + va))
+                                            continue;
+                                        if (!d && a && !(vm + vc + vd + vk + va))
+                                            continue;
+                                        night |= reach(m - vm, c - vc, d - vd, k - vk, a - va, FORCED_VOTE);
+                                    }
+
+                    uint8_t &n = win_[at(m, c, d, k, a, FORCED_NIGHT)];
+                    uint8_t &v = win_[at(m, c, d, k, a, FORCED_VOTE)];
+                    if ((n | night) != n || (v | vote) != v) {
+                        n |= night;
+                        v |= vote;
+                        changed = true;
+                    }
+                }
+            }
+        }
+    }
+
+    // the winner if the position is decided, else 0
+    int decided(const int &m, const int &c, const int &d, const int &k, const int &a, const int &ph) const {
+        uint8_t w = win_[at(m, c, d, k, a, ph)];
+        return w && !(w & (w - 1)) ? __builtin_ctz(w) : 0;
+    }
+};
+
+// One table per lobby make-up, shared by all of its games; nullptr if the
+// lobby is too large for one or would take too long to build
+std::shared_ptr<const Forced_table> forced_table(const int &M, const int &C, const int &D, const int &K, const int &A) {
+    static std::mutex mut;
+    static std::map<std::tuple<int, int, int, int, int>, std::shared_ptr<const Forced_table>> tables;
+
+    if (Forced_table::size(M, C, D, K, A) > Forced_table::max_size_ ||
+            Forced_table::work(M, C, D, K, A) > Forced_table::max_work_)
+        return nullptr;
+
+    std::lock_guard<std::mutex> lg{mut};
+    auto &t = tables[{M, C, D, K, A}];
+    if (!t)
+        t = std::make_shared<const Forced_table>(M, C, D, K, A);
+
+    return t;
+}
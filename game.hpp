@@ -1 +1,549 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <random>
+
+#include "archive.hpp"
 #include "players.hpp"
+#include "plugin.hpp"
+#include "pool.hpp"
+#include "results.hpp"
+
+// Seats per task of the pool driven Game. A lobby of more is played by
+// several tasks at once and what the bots read of the votes of the phase
+// depends on their timing, so the same seed no longer gives the same game.
+const int game_grain_ = 64;
+
+// How many seats of each role a game has, the rest are civilians
+struct Config
+{
+    int N_{0};
+    int mafia_count_{0};
+    int doc_count_{1};
+    int coma_count_{1};
+    int mana_count_{1};
+    int strategy_[MAFIA + 1] = {STRAT_BASE, STRAT_BASE, STRAT_BASE, STRAT_BASE, STRAT_BASE}; // by role
+    Bot_params params_;                                   // of the STRAT_TUNED roles
+    std::shared_ptr<Plugin> plugin_[MAFIA + 1];           // by role, over strategy_
+    std::map<int, std::shared_ptr<Plugin>> seat_plugin_;  // by seat, over plugin_
+    bool crn_{false};                                     // draws by seat and phase, for paired runs of up to game_grain_ seats
+    std::shared_ptr<const Policy> policy_;                // of the STRAT_POLICY roles
+    bool early_end_{false};                               // stop at a forced winner, see build_forced
+    std::shared_ptr<const Forced_table> forced_;          // with early_end_, by build_forced
+
+    int special(void) const {
+        return doc_count_ + coma_count_ + mana_count_;
+    }
+
+    bool valid(void) const {
+        return mafia_count_ > 0 && doc_count_ >= 0 && coma_count_ >= 0 &&
+            mana_count_ >= 0 && special() + mafia_count_ <= N_;
+    }
+};
+
+// The Forced_table of an early_end_ lobby, built once before its games
+// start. early_end_ is turned off, and false returned, if it can't be
+// had: the lobby is too large or has plugins, which may leave a kill out.
+bool build_forced(Config &conf) {
+    bool plugins = !conf.seat_plugin_.empty();
+    for (auto &p : conf.plugin_)
+        plugins |= bool(p);
+
+    conf.forced_.reset();
+    if (!conf.early_end_)
+        return true;
+
+    if (!plugins)
+        conf.forced_ = forced_table(conf.mafia_count_, conf.N_ - conf.mafia_count_ - conf.special(),
+            conf.doc_count_, conf.coma_count_, conf.mana_count_);
+
+    conf.early_end_ = bool(conf.forced_);
+    return conf.early_end_;
+}
+
+std::vector<int> deal_roles(const Config &conf, Rng &g) {
+    std::vector<int> pers(conf.N_, CIVILIAN);
+    auto it = pers.begin();
+
+    it = std::fill_n(it, conf.doc_count_, DOC);
+    it = std::fill_n(it, conf.coma_count_, COMA);
+    it = std::fill_n(it, conf.mana_count_, MANA);
+    std::fill_n(it, conf.mafia_count_, MAFIA);
+
+    std::shuffle(pers.begin(), pers.end(), g);
+
+    return pers;
+}
+
+Player *make_player(const int &role,
+    const int &num,
+    const bool &cmd,
+    Shared_ptr<Data> &data,
+    Shared_ptr<Host_channel> &to_host,
+    Shared_ptr<Mafia_privat> &mafia_privat,
+    const uint64_t &seed,
+    const int &strategy = STRAT_BASE,
+    const Bot_params &params = Bot_params(),
+    const std::shared_ptr<const Policy> &policy = nullptr)
+{
+    Player *p = nullptr;
+
+    if (cmd) {
+        switch (role) {
+            case CIVILIAN:
+                p = new Civilian_cmd(num, data);
+                break;
+            case DOC:
+                p = new Doc_cmd(num, data, to_host);
+                break;
+            case COMA:
+                p = new Coma_cmd(num, data, to_host);
+                break;
+            case MANA:
+                p = new Mana_cmd(num, data, to_host);
+                break;
+            case MAFIA:
+                p = new Mafia_cmd(num, data, mafia_privat);
+                break;
+        }
+    } else {
+        switch (role) {
+            case CIVILIAN:
+                if (strategy == STRAT_TUNED)
+                    p = new Civilian_tuned(num, data, params);
+                else if (strategy == STRAT_POLICY)
+                    p = new Civilian_policy(num, data, policy);
+                else if (strategy == STRAT_SUSPECT)
+                    p = new Civilian_suspect(num, data);
+                else
+                    p = new Civilian(num, data);
+                break;
+            case DOC:
+                if (strategy == STRAT_TUNED)
+                    p = new Doc_tuned(num, data, to_host, params);
+                else if (strategy == STRAT_POLICY)
+                    p = new Doc_policy(num, data, to_host, policy);
+                else if (strategy == STRAT_SELF)
+                    p = new Doc_self(num, data, to_host);
+                else
+                    p = new Doc(num, data, to_host);
+                break;
+            case COMA:
+                if (strategy == STRAT_TUNED)
+                    p = new Coma_tuned(num, data, to_host, params);
+                else if (strategy == STRAT_POLICY)
+                    p = new Coma_policy(num, data, to_host, policy);
+                else if (strategy == STRAT_CHECK)
+                    p = new Coma_check(num, data, to_host);
+                else
+                    p = new Coma(num, data, to_host);
+                break;
+            case MANA:
+                if (strategy == STRAT_POLICY)
+                    p = new Mana_policy(num, data, to_host, policy);
+                else
+                    p = new Mana(num, data, to_host);
+                break;
+            case MAFIA:
+                if (strategy == STRAT_TUNED)
+                    p = new Mafia_tuned(num, data, mafia_privat, params);
+                else if (strategy == STRAT_POLICY)
+                    p = new Mafia_policy(num, data, mafia_privat, policy);
+                else if (strategy == STRAT_FOCUS)
+                    p = new Mafia_focus(num, data, mafia_privat);
+                else
+                    p = new Mafia(num, data, mafia_privat);
+                break;
+        }
+    }
+
+    if (p)
+        p->seed(seed);
+
+    return p;
+}
+
+// A game on N + 1 threads of its own, the way it is played at the
+// terminal; cmd - the seats of humans, the rest are the bots of conf
+Game_rec play_threaded(const Config &conf,
+    std::vector<int> pers,
+    const std::vector<bool> &cmd,
+    const uint64_t &seed,
+    const bool &op_cl_info)
+{
+    int N = conf.N_;
+
+    Shared_ptr<Data> data = new Data(N, conf.mafia_count_);
+    Shared_ptr<Host_channel> to_host = new Host_channel(pers);
+    Shared_ptr<Mafia_privat> mafia_privat = new Mafia_privat(pers);
+
+    if (conf.strategy_[CIVILIAN] == STRAT_SUSPECT)
+        data->susp_ = std::make_shared<Suspicion>(N);
+    data->crn_ = conf.crn_;
+    // a human seat may be scripted to name no one
+    if (std::find(cmd.begin(), cmd.end(), true) == cmd.end())
+        data->forced_ = conf.forced_;
+
+    std::promise<int> p_doc, p_mana;
+    std::shared_future<int> f_doc = p_doc.get_future(), f_mana = p_mana.get_future();
+
+    std::vector<Player*> players_struct;
+    Host host = Host(
+        data, 
+        to_host, 
+        mafia_privat, 
+        pers,
+        f_doc,
+        f_mana,
+        op_cl_info
+    );
+
+    host.seed(seed);
+
+    for (int i = 0; i < N; ++i)
+        players_struct.push_back(make_player(pers[i], i, cmd[i], data, to_host, mafia_privat,
+            seed, conf.strategy_[pers[i]], conf.params_, conf.policy_));
+
+    std::vector<std::thread> t;
+
+    std::thread th{&Host::host_loop, &host};
+
+    for (int i = 0; i < N; ++i) 
+        t.push_back(std::thread {&Player::game_loop, players_struct[i]});
+
+    th.join();
+
+    for (int i = 0; i < N; ++i) {
+        t[i].join();
+        delete players_struct[i];
+    }
+
+    return host.rec();
+}
+
+// Bot only game driven by a Pool instead of N+1 own threads. Every phase
+// is split into tasks of at most grain_ players, the task that finishes
+// last runs the host step and schedules the next phase.
+class Game
+{
+    static const int grain_ = game_grain_;
+
+    Pool &pool_;
+    std::vector<int> pers_;
+    Shared_ptr<Data> data_;
+    Shared_ptr<Host_channel> to_host_;
+    Shared_ptr<Mafia_privat> mafia_privat_;
+    std::shared_future<int> f_doc_;
+    std::shared_future<int> f_mana_;
+    Host host_;
+    std::vector<std::unique_ptr<Plugin_group>> groups_;
+    std::vector<Player*> players_;
+    std::vector<int> live_; // who acts in the current phase
+    std::atomic<int> left_;
+    std::function<void(Game *)> on_end_;
+    int res_{0};
+
+    static std::vector<int> deal(const Config &conf, const uint64_t &seed) {
+        Rng g(seed);
+        return deal_roles(conf, g);
+    }
+
+    void run(void (Player::*step)(void), void (Game::*next)(void), const char *name) {
+        live_.clear();
+        for (int i = 0; i < data_->N_; ++i)
+            if (data_->is_live_[i])
+                live_.push_back(i);
+
+        int chunks = (live_.size() + grain_ - 1) / grain_;
+        // day() is one ahead once the night began, the first night is 0
+        int phase = 2 * (host_.day() - 2) + (step == &Player::vote);
+        left_.store(chunks);
+
+        for (int c = 0; c < chunks; ++c) {
+            pool_.submit([this, c, step, next, name, phase] {
+                int end = std::min((c + 1) * grain_, int(live_.size()));
+
+                {
+                    Trace_scope ts{name, c};
+
+                    for (int i = c * grain_; i < end; ++i) {
+                        players_[live_[i]]->phase_rng(phase);
+                        (players_[live_[i]]->*step)();
+                    }
+                }
+
+                if (left_.fetch_sub(1, std::memory_order_acq_rel) == 1)
+                    (this->*next)();
+            });
+        }
+    }
+
+    void retire(void) {
+        for (auto i : live_)
+            if (!data_->is_live_[i])
+                players_[i]->act_after_die();
+    }
+
+    // one call per plugin and role for all of its live seats
+    void decide(const int &phase) {
+        for (auto &g : groups_)
+            if (phase == MAFIA_DAY || g->role() != CIVILIAN)
+                g->decide(*data_, host_.day() - 1, phase);
+    }
+
+    void night(void) {
+        host_.night_begin();
+        decide(MAFIA_NIGHT);
+        run(&Player::act, &Game::night_res, "act");
+    }
+
+    void night_res(void) {
+        int state_res = host_.night_res();
+
+        for (auto i : live_)
+            players_[i]->act_res();
+
+        retire();
+
+        if (state_res)
+            return end(state_res);
+
+        host_.day_begin();
+        decide(MAFIA_DAY);
+        run(&Player::vote, &Game::day_res, "vote");
+    }
+
+    void day_res(void) {
+        int state_res = host_.day_res();
+
+        retire();
+
+        if (state_res)
+            return end(state_res);
+
+        night();
+    }
+
+    void end(const int &state_res) {
+        res_ = state_res;
+        host_.print_res(state_res);
+
+        // on_end_ may delete the game
+        auto on_end = on_end_;
+        on_end(this);
+    }
+
+public:
+    Game (Pool &pool,
+        const Config &conf,
+        const uint64_t &seed,
+        std::function<void(Game *)> on_end,
+        bool print = false)
+        :
+        pool_(pool),
+        pers_(deal(conf, seed)),
+        data_(new Data(conf.N_, conf.mafia_count_)),
+        to_host_(new Host_channel(pers_)),
+        mafia_privat_(new Mafia_privat(pers_)),
+        host_(data_, to_host_, mafia_privat_,
+            pers_, f_doc_, f_mana_, false, print),
+        on_end_(on_end)
+    {
+        host_.seed(seed);
+
+        if (conf.strategy_[CIVILIAN] == STRAT_SUSPECT)
+            data_->susp_ = std::make_shared<Suspicion>(conf.N_);
+        data_->crn_ = conf.crn_;
+        data_->forced_ = conf.forced_;
+
+        // one seat a game learns, by the seed
+        if (conf.policy_ && conf.policy_->eps_ > 0) {
+            int seat = Rng::phase(seed, -1, conf.N_).randint(0, conf.N_ - 1);
+            data_->learn_ = std::make_shared<Policy_learn>(Policy_learn{seat, pers_[seat], {}});
+        }
+
+        for (int i = 0; i < conf.N_; ++i) {
+            auto seat = conf.seat_plugin_.find(i);
+            auto plugin = seat != conf.seat_plugin_.end() ? seat->second : conf.plugin_[pers_[i]];
+
+            if (!plugin) {
+                players_.push_back(make_player(pers_[i], i, false, data_,
+                    to_host_, mafia_privat_, seed, conf.strategy_[pers_[i]], conf.params_, conf.policy_));
+                continue;
+            }
+
+            Plugin_group *group = nullptr;
+            for (auto &g : groups_)
+                if (g->plugin() == plugin.get() && g->role() == pers_[i])
+                    group = g.get();
+
+            if (!group) {
+                groups_.push_back(std::make_unique<Plugin_group>(plugin, pers_[i], conf.N_,
+                    Rng(seed, conf.N_ + 1 + groups_.size()).next()));
+                group = groups_.back().get();
+                if (pers_[i] == MAFIA)
+                    group->know_mafia(pers_);
+            }
+
+            group->add(i);
+            players_.push_back(new Plugin_player(pers_[i], i, data_, to_host_, mafia_privat_, group));
+            players_.back()->seed(seed);
+        }
+    }
+
+    Game (const Game &) = delete;
+    Game &operator=(const Game &) = delete;
+
+    void start(void) {
+        pool_.submit([this] { night(); });
+    }
+
+    int res(void) const { //1 - civ, 2 - maf, 3 - man
+        return res_;
+    }
+
+    int days(void) const {
+        return host_.day() - 1;
+    }
+
+    const Game_rec &rec(void) const {
+        return host_.rec();
+    }
+
+    // while conf.policy_ is learned
+    const Policy_learn *learn(void) const {
+        return data_->learn_.get();
+    }
+
+    ~Game() {
+        for (auto i : players_)
+            delete i;
+    }
+};
+
+// Plays `games` games on the pool, at most in_flight at once, game i of
+// conf_of(i) and seed seed + i, and calls done(game, latency in ms) for
+// each of them from the worker that finished it. Returns the in_flight used.
+int play_games(Pool &pool,
+    const long long &games,
+    std::function<const Config &(long long)> conf_of,
+    int in_flight,
+    const uint64_t &seed,
+    std::function<void(Game *, double)> done)
+{
+    using clock = std::chrono::steady_clock;
+
+    if (in_flight <= 0)
+        in_flight = 4 * pool.size();
+
+    std::mutex mut;
+    std::condition_variable cv;
+    long long started = 0;
+    long long finished = 0;
+
+    std::function<void(void)> launch;
+
+    // called under mut
+    launch = [&] {
+        auto begin = clock::now();
+
+        Game *game = new Game(pool, conf_of(started), seed + started, [&, begin](Game *gm) {
+            double ms = std::chrono::duration<double, std::milli>(clock::now() - begin).count();
+
+            done(gm, ms);
+
+            std::unique_lock<std::mutex> ul{mut};
+
+            ++finished;
+            delete gm;
+
+            if (started < games)
+                launch();
+            else if (finished == games)
+                cv.notify_one();
+        });
+
+        ++started;
+        game->start();
+    };
+
+    std::unique_lock<std::mutex> ul{mut};
+    for (int i = 0; i < in_flight && started < games; ++i)
+        launch();
+
+    cv.wait(ul, [&] { return finished == games; });
+
+    return in_flight;
+}
+
+int play_games(Pool &pool,
+    const long long &games,
+    const Config &conf,
+    int in_flight,
+    const uint64_t &seed,
+    std::function<void(Game *, double)> done)
+{
+    return play_games(pool, games, [&conf](long long) -> const Config & { return conf; }, in_flight, seed, done);
+}
+
+// play_games with a summary; with out every game is also written to the
+// results file, with arch to the archive.
+void run_games(Pool &pool,
+    const long long &games,
+    const Config &conf,
+    int in_flight,
+    const uint64_t &seed,
+    Results_writer *out = nullptr,
+    Archive_writer *arch = nullptr)
+{
+    using clock = std::chrono::steady_clock;
+
+    std::mutex mut;
+    long long wins[4] = {0, 0, 0, 0};
+    long long days = 0;
+    long long decided = 0;
+    std::vector<double> lat;
+
+    lat.reserve(games);
+
+    auto begin = clock::now();
+
+    in_flight = play_games(pool, games, conf, in_flight, seed, [&](Game *gm, double ms) {
+        if (out)
+            out->add(gm->rec());
+        if (arch)
+            arch->add(gm->rec());
+
+        std::lock_guard<std::mutex> lg{mut};
+
+        ++wins[gm->res()];
+        days += gm->days();
+        decided += gm->rec().decided_ > 0;
+        lat.push_back(ms);
+    });
+
+    double sec = std::chrono::duration<double>(clock::now() - begin).count();
+
+    std::sort(lat.begin(), lat.end());
+
+    std::cout << "Games " << games << " on " << pool.size() << " threads, "
+        << in_flight << " in flight, seed " << seed << "\n";
+    std::cout << "Players " << conf.N_ << ", mafia " << conf.mafia_count_
+        << ", doc " << conf.doc_count_ << ", coma " << conf.coma_count_
+        << ", mana " << conf.mana_count_ << "\n";
+    std::cout << "Time " << sec << " s, " << games / sec << " games/s\n";
+    std::cout << "Civillian win " << wins[1] << "\n";
+    std::cout << "Mafia win " << wins[2] << "\n";
+    std::cout << "Mana win " << wins[3] << "\n";
+    std::cout << "Average days " << double(days) / games << "\n";
+    if (conf.early_end_)
+        std::cout << "Decided early " << decided << "\n";
+    if (!lat.empty())
+        std::cout << "Latency ms p50 " << lat[lat.size() / 2]
+            << " p99 " << lat[lat.size() * 99 / 100]
+            << " max " << lat.back() << "\n";
+    std::cout.flush();
+}
@@ -0,0 +1,367 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <future>
+#include <iostream>
+#include <mutex>
+#include <random>
+#include <vector>
+
+#if defined(__BMI2__)
+#include <immintrin.h>
+#endif
+
+#include "players.hpp"
+#include "pool.hpp"
+
+// k-th (from 0) set bit of m
+inline int select_bit(uint64_t m, const int &k) {
+#if defined(__BMI2__)
+    return __builtin_ctzll(_pdep_u64(uint64_t(1) << k, m));
+#else
+    for (int i = 0; i < k; ++i)
+        m &= m - 1;
+    return __builtin_ctzll(m);
+#endif
+}
+
+// Batch engine: L independent bot games of N <= 64 seats side by side in
+// structure-of-arrays form, one bit per seat in the masks. Every phase is
+// a loop over the lanes with the same straight-line code for each lane and
+// the lane's active flag as a mask, so the compiler can vectorize the rng,
+// the mask algebra, the popcounts and the vote counting (build with
+// -O3 -march=native to get AVX2/AVX-512). A lane whose game ends is
+// refilled with a new one at the end of the round.
+//
+// Rules and bots are the ones of Host and players.hpp. Coma keeps the
+// mafia it found as a mask and goes for the lowest seat instead of the
+// oldest one, which doesn't change the odds since all mafia bots are alike.
+template <int L = 16>
+class Lanes
+{
+    int N_;
+    int mafia_count_;
+    uint64_t all_;
+
+    alignas(64) uint64_t rng_[L];
+    alignas(64) uint64_t live_[L];
+    alignas(64) uint64_t mafia_[L];
+    alignas(64) uint64_t checked_[L]; // Coma::s_
+    alignas(64) uint64_t known_[L];   // Coma::q_
+    alignas(64) int32_t doc_[L];
+    alignas(64) int32_t coma_[L];
+    alignas(64) int32_t mana_[L];
+    alignas(64) int32_t prev_safe_[L]; // Doc::prev_safe_
+    alignas(64) int32_t days_[L];
+    alignas(64) int32_t active_[L];
+    alignas(64) int32_t res_[L];
+    alignas(64) int32_t free_[L];
+    alignas(64) uint8_t votes_[64][L];
+
+    long long left_{0}; // games not started yet
+
+    uint32_t next(const int &l) {
+        uint64_t x = rng_[l];
+        x ^= x << 13;
+        x ^= x >> 7;
+        x ^= x << 17;
+        rng_[l] = x;
+        return x >> 32;
+    }
+
+    // uniform in [0, n)
+    int draw(const int &l, const int &n) {
+        return (uint64_t(next(l)) * uint32_t(n)) >> 32;
+    }
+
+    // mask is empty only in idle lanes, whose result is thrown away
+    int random_seat(const int &l, const uint64_t &mask) {
+        return select_bit(mask ? mask : 1, draw(l, __builtin_popcountll(mask)));
+    }
+
+    static uint64_t bit(const int &seat) {
+        return seat < 0 ? 0 : uint64_t(1) << seat;
+    }
+
+    void deal(const int &l) {
+        int pers[64];
+
+        for (int i = 0; i < N_; ++i)
+            pers[i] = i < 3 ? DOC + i : (i < 3 + mafia_count_ ? MAFIA : CIVILIAN);
+
+        for (int i = N_ - 1; i > 0; --i)
+            std::swap(pers[i], pers[draw(l, i + 1)]);
+
+        live_[l] = all_;
+        mafia_[l] = 0;
+        checked_[l] = 0;
+        known_[l] = 0;
+        prev_safe_[l] = -1;
+        days_[l] = 0;
+        res_[l] = 0;
+
+        for (int i = 0; i < N_; ++i) {
+            switch (pers[i]) {
+                case DOC:
+                    doc_[l] = i;
+                    break;
+                case COMA:
+                    coma_[l] = i;
+                    break;
+                case MANA:
+                    mana_[l] = i;
+                    break;
+                case MAFIA:
+                    mafia_[l] |= bit(i);
+                    break;
+            }
+        }
+    }
+
+    void state_game(void) { //0 - go, 1 - civ, 2 - maf, 3 - man
+        for (int l = 0; l < L; ++l) {
+            int lm = __builtin_popcountll(live_[l] & mafia_[l]);
+            int ac = __builtin_popcountll(live_[l] & ~mafia_[l]);
+            int mana = (live_[l] >> mana_[l]) & 1;
+
+            int res = lm > ac ? 2 :
+                lm == ac ? (mana ? 0 : 2) :
+                lm == 0 ? (mana ? 3 : 1) : 0;
+
+            res_[l] = active_[l] ? res : 0;
+        }
+    }
+
+    void night(void) {
+        int32_t t_mana[L], t_coma[L], t_mafia[L], t_doc[L];
+
+        for (int l = 0; l < L; ++l) {
+            uint64_t live = live_[l];
+            bool act = active_[l];
+
+            // Mana
+            bool mana = act && ((live >> mana_[l]) & 1);
+            t_mana[l] = mana ? random_seat(l, live & ~bit(mana_[l])) : -1;
+
+            // Coma
+            bool coma = act && ((live >> coma_[l]) & 1);
+            uint64_t uncheck = live & ~checked_[l] & ~bit(coma_[l]);
+            uint64_t known = known_[l] & live;
+            bool check = draw(l, 2) && uncheck;
+
+            int target = -1;
+            if (coma && check) {
+                target = random_seat(l, uncheck);
+                checked_[l] |= bit(target);
+                known_[l] |= bit(target) & mafia_[l];
+            } else if (coma) {
+                target = known ? __builtin_ctzll(known) : random_seat(l, live & ~bit(coma_[l]));
+                known_[l] &= ~bit(target);
+            }
+            t_coma[l] = check ? -1 : target;
+
+            // Doc
+            bool doc = act && ((live >> doc_[l]) & 1);
+            t_doc[l] = doc ? random_seat(l, live & ~bit(prev_safe_[l])) : -1;
+            prev_safe_[l] = doc ? t_doc[l] : prev_safe_[l];
+        }
+
+        // Mafia: vote by vote over the lanes, then the most voted seat
+        int rounds = 0;
+        for (int l = 0; l < L; ++l)
+            rounds = std::max(rounds, __builtin_popcountll(live_[l] & mafia_[l]));
+
+        for (int j = 0; j < rounds; ++j) {
+            for (int l = 0; l < L; ++l) {
+                bool vote = active_[l] && j < __builtin_popcountll(live_[l] & mafia_[l]);
+                votes_[random_seat(l, live_[l] & ~mafia_[l])][l] += vote;
+            }
+        }
+
+        uint8_t best[L] = {};
+        for (int l = 0; l < L; ++l)
+            t_mafia[l] = -1;
+
+        for (int s = 0; s < N_; ++s) {
+            for (int l = 0; l < L; ++l) {
+                bool more = votes_[s][l] > best[l];
+                best[l] = more ? votes_[s][l] : best[l];
+                t_mafia[l] = more ? s : t_mafia[l];
+                votes_[s][l] = 0;
+            }
+        }
+
+        for (int l = 0; l < L; ++l) {
+            uint64_t kill = bit(t_mana[l]) | bit(t_mafia[l]) | bit(t_coma[l]);
+            live_[l] &= ~(kill & ~bit(t_doc[l]));
+            days_[l] += active_[l];
+        }
+    }
+
+    void day(void) {
+        for (int s = 0; s < N_; ++s) {
+            for (int l = 0; l < L; ++l) {
+                uint64_t live = live_[l];
+                bool vote = active_[l] && ((live >> s) & 1);
+                uint64_t known = known_[l] & live;
+                int target;
+
+                if (s == coma_[l])
+                    target = known ? __builtin_ctzll(known) : random_seat(l, live);
+                else
+                    target = random_seat(l, live & ~bit(s));
+
+                votes_[target][l] += vote;
+            }
+        }
+
+        uint8_t best[L] = {};
+        uint64_t tie[L] = {};
+
+        for (int s = 0; s < N_; ++s) {
+            for (int l = 0; l < L; ++l) {
+                uint8_t v = votes_[s][l];
+                bool more = v > best[l];
+                best[l] = more ? v : best[l];
+                tie[l] = more ? bit(s) : (v == best[l] ? tie[l] | bit(s) : tie[l]);
+                votes_[s][l] = 0;
+            }
+        }
+
+        for (int l = 0; l < L; ++l) {
+            int r = __builtin_popcountll(tie[l]);
+            int kick = -1;
+
+            if (r == 1)
+                kick = __builtin_ctzll(tie[l]);
+            else if (draw(l, 2))
+                kick = select_bit(tie[l], draw(l, r));
+
+            live_[l] &= active_[l] ? ~bit(kick) : ~uint64_t(0);
+        }
+    }
+
+    // finished lanes report and are masked off
+    template <typename F>
+    void finish(F &&done) {
+        for (int l = 0; l < L; ++l) {
+            if (!res_[l])
+                continue;
+
+            done(res_[l], days_[l]);
+            active_[l] = 0;
+            free_[l] = 1;
+            res_[l] = 0;
+        }
+    }
+
+    // new games start with a night, so lanes are refilled between rounds
+    bool refill(void) {
+        bool any = false;
+
+        for (int l = 0; l < L; ++l) {
+            if (free_[l] && left_ > 0) {
+                --left_;
+                deal(l);
+                active_[l] = 1;
+                free_[l] = 0;
+            }
+
+            any |= active_[l];
+        }
+
+        return any;
+    }
+
+public:
+    Lanes (const int &N, const int &mafia_count, const uint64_t &seed) :
+        N_(N),
+        mafia_count_(mafia_count),
+        all_(N == 64 ? ~uint64_t(0) : (uint64_t(1) << N) - 1)
+    {
+        std::mt19937_64 g(seed);
+
+        for (int l = 0; l < L; ++l) {
+            rng_[l] = g() | 1;
+            active_[l] = 0;
+            free_[l] = 1;
+            res_[l] = 0;
+            doc_[l] = coma_[l] = mana_[l] = 0;
+            live_[l] = mafia_[l] = 0;
+        }
+
+        for (int s = 0; s < 64; ++s)
+            for (int l = 0; l < L; ++l)
+                votes_[s][l] = 0;
+    }
+
+    // plays `games` games, done(winner, days) is called for each of them
+    template <typename F>
+    void run(const long long &games, F &&done) {
+        left_ = games;
+
+        while (refill()) {
+            night();
+            state_game();
+            finish(done);
+
+            day();
+            state_game();
+            finish(done);
+        }
+    }
+};
+
+// Splits `games` over the pool, one Lanes batch per worker.
+void run_lanes(Pool &pool, const long long &games, const int &N, const int &mafia_count) {
+    using clock = std::chrono::steady_clock;
+
+    std::mutex mut;
+    long long wins[4] = {0, 0, 0, 0};
+    long long days = 0;
+    std::random_device rd;
+    int parts = pool.size();
+
+    auto begin = clock::now();
+
+    {
+        std::vector<std::future<void>> f;
+
+        for (int p = 0; p < parts; ++p) {
+            long long share = games / parts + (p < games % parts);
+            uint64_t seed = (uint64_t(rd()) << 32) | rd();
+            auto task = std::make_shared<std::packaged_task<void(void)>>([&, share, seed] {
+                long long w[4] = {0, 0, 0, 0};
+                long long d = 0;
+                auto lanes = std::make_unique<Lanes<16>>(N, mafia_count, seed);
+
+                lanes->run(share, [&](int res, int day) {
+                    ++w[res];
+                    d += day;
+                });
+
+                std::lock_guard<std::mutex> lg{mut};
+                for (int i = 0; i < 4; ++i)
+                    wins[i] += w[i];
+                days += d;
+            });
+
+            f.push_back(task->get_future());
+            pool.submit([task] { (*task)(); });
+        }
+
+        for (auto &i : f)
+            i.wait();
+    }
+
+    double sec = std::chrono::duration<double>(clock::now() - begin).count();
+
+    std::cout << "Games " << games << " in lanes of 16 on " << parts << " threads\n";
+    std::cout << "Time " << sec << " s, " << games / sec << " games/s\n";
+    std::cout << "Civillian win " << wins[1] << "\n";
+    std::cout << "Mafia win " << wins[2] << "\n";
+    std::cout << "Mana win " << wins[3] << "\n";
+    std::cout << "Average days " << double(days) / games << "\n";
+    std::cout.flush();
+}
@@ -0,0 +1,228 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "game.hpp"
+
+// League of strategies per role. Every game is a matchup: one entrant for
+// each role, the civilian team (Civilian, Doc, Coma and a side term for
+// the lobby's bias towards the mafia) against the Mafia. Each entrant has
+// a TrueSkill style Gaussian rating (mu, var), a team is the sum of its
+// members, and a civilian or mafia win moves the ratings of both teams;
+// Mana wins say nothing about the two teams and are skipped.
+//
+// Workers update the ratings as their games end, without locks: the
+// deltas come from a relaxed snapshot, mu takes them by fetch_add and var
+// shrinks by a CAS loop. The next matchup is the one where the outcome is
+// least certain, p (1 - p), times the rating variance at stake.
+
+const double league_beta_ = 1.0;   // performance noise of a team
+
+struct League_entrant
+{
+    std::string name_;
+    int role_;
+    int strategy_;
+    std::shared_ptr<Plugin> plugin_;
+    std::atomic<double> mu_{0};
+    std::atomic<double> var_{4};
+    std::atomic<long long> games_{0};
+};
+
+inline double norm_pdf(const double &x) {
+    return std::exp(-x * x / 2) / std::sqrt(2 * M_PI);
+}
+
+inline double norm_cdf(const double &x) {
+    return std::erfc(-x / std::sqrt(2)) / 2;
+}
+
+class League
+{
+    std::vector<std::unique_ptr<League_entrant>> ents_;
+    std::vector<std::vector<int>> by_role_;  // entrants of a role
+    std::vector<std::vector<int>> matchups_; // entrants, side term first
+    std::vector<Config> confs_;              // of the matchups
+
+    static void shrink(std::atomic<double> &var, const double &f) {
+        double v = var.load(std::memory_order_relaxed);
+        while (!var.compare_exchange_weak(v, std::max(v * f, 1e-4), std::memory_order_relaxed))
+            ;
+    }
+
+    int add(const std::string &name, const int &role, const int &strategy,
+        const std::shared_ptr<Plugin> &plugin = nullptr)
+    {
+        ents_.push_back(std::make_unique<League_entrant>());
+        auto &e = *ents_.back();
+        e.name_ = name;
+        e.role_ = role;
+        e.strategy_ = strategy;
+        e.plugin_ = plugin;
+        if (role >= 0)
+            by_role_[role].push_back(ents_.size() - 1);
+        return ents_.size() - 1;
+    }
+
+public:
+    // plugins by role join the built in strategies, not for the Mana
+    League (const Config &conf, const std::vector<std::pair<int, std::shared_ptr<Plugin>>> &plugins) :
+        by_role_(MAFIA + 1)
+    {
+        add("side", -1, STRAT_BASE);
+        add("civilian base", CIVILIAN, STRAT_BASE);
+        add("civilian suspect", CIVILIAN, STRAT_SUSPECT);
+        add("doc base", DOC, STRAT_BASE);
+        add("doc self", DOC, STRAT_SELF);
+        add("coma base", COMA, STRAT_BASE);
+        add("coma check", COMA, STRAT_CHECK);
+        add("mafia base", MAFIA, STRAT_BASE);
+        add("mafia focus", MAFIA, STRAT_FOCUS);
+
+        for (auto &p : plugins)
+            add(num_to_role[p.first] + " " + p.second->path(), p.first, STRAT_BASE, p.second);
+
+        // every combination of one entrant per role, the Mana stays base
+        for (int c : by_role_[CIVILIAN])
+            for (int d : by_role_[DOC])
+                for (int k : by_role_[COMA])
+                    for (int f : by_role_[MAFIA]) {
+                        Config mc = conf;
+
+                        for (int e : {c, d, k, f}) {
+                            mc.strategy_[ents_[e]->role_] = ents_[e]->strategy_;
+                            mc.plugin_[ents_[e]->role_] = ents_[e]->plugin_;
+                        }
+
+                        matchups_.push_back({0, c, d, k, f});
+                        confs_.push_back(mc);
+                    }
+    }
+
+    League (const League &) = delete;
+    League &operator=(const League &) = delete;
+
+    size_t matchups(void) const {
+        return matchups_.size();
+    }
+
+    const Config &conf(const int &m) const {
+        return confs_[m];
+    }
+
+    double c2(const std::vector<int> &m) const {
+        double c2 = 2 * league_beta_ * league_beta_;
+        for (int e : m)
+            c2 += ents_[e]->var_.load(std::memory_order_relaxed);
+        return c2;
+    }
+
+    // civilian team minus mafia
+    double diff(const std::vector<int> &m) const {
+        double d = 0;
+        for (int e : m)
+            d += ents_[e]->role_ == MAFIA ? -ents_[e]->mu_.load(std::memory_order_relaxed) :
+                ents_[e]->mu_.load(std::memory_order_relaxed);
+        return d;
+    }
+
+    // the matchup that teaches the most now
+    int next(void) const {
+        int best = 0;
+        double best_gain = -1;
+
+        for (size_t i = 0; i < matchups_.size(); ++i) {
+            double c2 = this->c2(matchups_[i]);
+            double p = norm_cdf(diff(matchups_[i]) / std::sqrt(c2));
+            double gain = p * (1 - p) * (c2 - 2 * league_beta_ * league_beta_);
+
+            if (gain > best_gain) {
+                best_gain = gain;
+                best = i;
+            }
+        }
+
+        return best;
+    }
+
+    // winner 1 - civ, 2 - maf; any thread
+    void update(const int &m, const int &winner) {
+        const std::vector<int> &ms = matchups_[m];
+
+        for (int e : ms)
+            ents_[e]->games_.fetch_add(1, std::memory_order_relaxed);
+
+        if (winner != 1 && winner != 2)
+            return;
+
+        double c2 = this->c2(ms);
+        double c = std::sqrt(c2);
+        double t = (winner == 1 ? diff(ms) : -diff(ms)) / c;
+        double v = norm_pdf(t) / std::max(norm_cdf(t), 1e-12);
+        double w = v * (v + t);
+
+        for (int e : ms) {
+            auto &en = *ents_[e];
+            double var = en.var_.load(std::memory_order_relaxed);
+            bool won = (en.role_ == MAFIA) == (winner == 2);
+
+            en.mu_.fetch_add((won ? 1 : -1) * var / c * v, std::memory_order_relaxed);
+            shrink(en.var_, 1 - var / c2 * w);
+        }
+    }
+
+    void print(void) const {
+        for (auto &e : ents_)
+            std::cout << std::left << std::setw(24) << e->name_ << std::right
+                << " mu " << std::setw(8) << std::fixed << std::setprecision(3) << e->mu_.load()
+                << " sigma " << std::setw(6) << std::sqrt(e->var_.load())
+                << " games " << e->games_.load() << std::defaultfloat << "\n";
+        std::cout.flush();
+    }
+};
+
+void run_league(Pool &pool,
+    const Config &conf,
+    const std::vector<std::pair<int, std::shared_ptr<Plugin>>> &plugins,
+    const long long &games,
+    const uint64_t &seed,
+    const long long &report = 20000)
+{
+    using clock = std::chrono::steady_clock;
+
+    League league(conf, plugins);
+    std::vector<int> matchup(games);
+    std::atomic<long long> done{0};
+
+    auto begin = clock::now();
+
+    std::cout << "League of " << league.matchups() << " matchups, " << games << " games, seed " << seed << "\n";
+    std::cout.flush();
+
+    // conf_of runs under play_games' lock, so next() sees the ratings of
+    // every game that has ended by then
+    play_games(pool, games, [&](long long i) -> const Config & {
+        matchup[i] = league.next();
+        return league.conf(matchup[i]);
+    }, 0, seed, [&](Game *gm, double) {
+        league.update(matchup[gm->rec().seed_ - seed], gm->res());
+
+        if (report > 0 && (done.fetch_add(1, std::memory_order_relaxed) + 1) % report == 0) {
+            std::osyncstream(std::cout) << "Games " << done.load() << "\n";
+        }
+    });
+
+    double sec = std::chrono::duration<double>(clock::now() - begin).count();
+
+    league.print();
+    std::cout << "Time " << sec << " s, " << games / sec << " games/s\n";
+    std::cout.flush();
+}
@@ -0,0 +1,367 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <random>
+#include <vector>
+
+#include "players.hpp"
+
+// Large lobby mode, for N up to 10^6 seats. The rules and the bots are the
+// same as in Host and players.hpp, but seats are plain indices into flat
+// arrays instead of a polymorphic Player and a thread each, and only
+// summaries are printed. Memory is about 16 bytes per seat.
+class Lobby
+{
+    int N_;
+    int mafia_count_;
+    std::mt19937_64 g_;
+    std::vector<uint8_t> role_;
+    std::vector<int> live_list_; // live seats, in no order
+    std::vector<int> pos_;       // seat -> index in live_list_, -1 if dead
+    std::vector<int> votes_;     // scratch counts, all zero between uses
+    std::vector<int> touched_;
+    int live_[MAFIA + 1] = {0, 0, 0, 0, 0};
+    int num_doc_{-1};
+    int num_coma_{-1};
+    int num_mana_{-1};
+    int day_{1};
+
+    // Doc
+    int prev_safe_{-1};
+
+    // Coma
+    std::vector<bool> checked_;
+    int unchecked_live_{0};
+    std::vector<int> coma_q_;
+    size_t coma_q_head_{0};
+
+    // last round, for the summaries
+    int night_dead_{0};
+    int kick_{-1};
+
+    int rand_int(const int &lo, const int &hi) {
+        return std::uniform_int_distribution<int>(lo, hi)(g_);
+    }
+
+    bool is_live(const int &num) const {
+        return num != -1 && pos_[num] != -1;
+    }
+
+    int random_live(void) {
+        return live_list_[rand_int(0, int(live_list_.size()) - 1)];
+    }
+
+    void kill(const int &num) {
+        int p = pos_[num];
+        int last = live_list_.back();
+
+        live_list_[p] = last;
+        pos_[last] = p;
+        live_list_.pop_back();
+        pos_[num] = -1;
+
+        --live_[role_[num]];
+        if (num != num_coma_ && !checked_[num])
+            --unchecked_live_;
+    }
+
+    void coma_state(void) {
+        while (coma_q_head_ < coma_q_.size() && !is_live(coma_q_[coma_q_head_]))
+            ++coma_q_head_;
+    }
+
+    int coma_act(bool &check) {
+        coma_state();
+        int target = -1;
+
+        check = rand_int(0, 1) && unchecked_live_ > 0;
+
+        if (!check) {
+            if (coma_q_head_ == coma_q_.size()) {
+                do
+                    target = random_live();
+                while (target == num_coma_);
+            } else {
+                target = coma_q_[coma_q_head_++];
+            }
+        } else {
+            do
+                target = random_live();
+            while (checked_[target] || target == num_coma_);
+
+            checked_[target] = true;
+            --unchecked_live_;
+        }
+
+        return target;
+    }
+
+    // most voted seat, smaller number on ties like Mafia_privat::mafia_choice
+    int mafia_choice(void) {
+        int tar = -1;
+        int count = 0;
+
+        touched_.clear();
+        for (auto i : live_list_) {
+            if (role_[i] != MAFIA)
+                continue;
+
+            int target;
+            do
+                target = random_live();
+            while (role_[target] == MAFIA);
+
+            if (!votes_[target]++)
+                touched_.push_back(target);
+        }
+
+        for (auto i : touched_) {
+            if (votes_[i] > count || (votes_[i] == count && i < tar)) {
+                count = votes_[i];
+                tar = i;
+            }
+            votes_[i] = 0;
+        }
+
+        return tar;
+    }
+
+    int state_game(void) { //0 - go, 1 - civ, 2 - maf, 3 - man
+        int live_mafia = live_[MAFIA];
+        int all_civ = live_[CIVILIAN] + live_[DOC] + live_[COMA] + live_[MANA];
+        bool mana = live_[MANA];
+
+        if (live_mafia > all_civ)
+            return 2;
+
+        if (mana && live_mafia == all_civ)
+            return 0;
+
+        if (!mana && live_mafia == all_civ)
+            return 2;
+
+        if (!live_mafia)
+            return mana ? 3 : 1;
+
+        return 0;
+    }
+
+    int night(void) {
+        int target_doc = -1;
+        int target_coma = -1;
+        int target_mana = -1;
+        int target_mafia = -1;
+        int target_check = -1;
+        bool check = false;
+
+        if (is_live(num_mana_)) {
+            do
+                target_mana = random_live();
+            while (target_mana == num_mana_);
+        }
+
+        if (is_live(num_coma_)) {
+            int target = coma_act(check);
+
+            if (check)
+                target_check = target;
+            else
+                target_coma = target;
+        }
+
+        target_mafia = mafia_choice();
+
+        if (is_live(num_doc_)) {
+            do
+                target_doc = random_live();
+            while (target_doc == prev_safe_);
+
+            prev_safe_ = target_doc;
+        }
+
+        if (target_check != -1 && role_[target_check] == MAFIA)
+            coma_q_.push_back(target_check);
+
+        night_dead_ = 0;
+        for (auto i : {target_mana, target_mafia, target_coma}) {
+            if (i != -1 && i != target_doc && is_live(i)) {
+                kill(i);
+                ++night_dead_;
+            }
+        }
+
+        return state_game();
+    }
+
+    int day(void) {
+        int count = 0;
+
+        coma_state();
+        touched_.clear();
+
+        for (auto i : live_list_) {
+            int target;
+
+            if (i == num_coma_ && coma_q_head_ < coma_q_.size()) {
+                target = coma_q_[coma_q_head_];
+            } else if (i == num_coma_) {
+                target = random_live();
+            } else {
+                do
+                    target = random_live();
+                while (target == i);
+            }
+
+            if (!votes_[target]++)
+                touched_.push_back(target);
+        }
+
+        for (auto i : touched_)
+            count = std::max(count, votes_[i]);
+
+        // seats sharing the top count end up in front of touched_
+        int r = 0;
+        for (size_t i = 0; i < touched_.size(); ++i) {
+            if (votes_[touched_[i]] == count)
+                std::swap(touched_[r++], touched_[i]);
+        }
+
+        kick_ = -1;
+        if (r == 1)
+            kick_ = touched_[0];
+        else if (rand_int(0, 1))
+            kick_ = touched_[rand_int(0, r - 1)];
+
+        for (auto i : touched_)
+            votes_[i] = 0;
+
+        if (kick_ != -1)
+            kill(kick_);
+
+        return state_game();
+    }
+
+    void print_day(void) {
+        std::cout << "Day " << day_
+            << ": live " << live_list_.size()
+            << " (mafia " << live_[MAFIA]
+            << ", civillian " << live_[CIVILIAN]
+            << ", doc " << live_[DOC]
+            << ", coma " << live_[COMA]
+            << ", mana " << live_[MANA]
+            << "), night kill " << night_dead_
+            << ", kick " << kick_ << "\n";
+    }
+
+public:
+    Lobby (const int &N, const int &mafia_count, const uint64_t &seed) :
+        N_(N),
+        mafia_count_(mafia_count),
+        g_(seed)
+    {
+        // bulk assignment: fill the role runs and shuffle the bytes
+        role_.assign(N_, CIVILIAN);
+        role_[0] = DOC; role_[1] = COMA; role_[2] = MANA;
+        std::fill(role_.begin() + 3, role_.begin() + 3 + mafia_count_, MAFIA);
+        std::shuffle(role_.begin(), role_.end(), g_);
+
+        live_list_.resize(N_);
+        pos_.resize(N_);
+        for (int i = 0; i < N_; ++i) {
+            live_list_[i] = i;
+            pos_[i] = i;
+            ++live_[role_[i]];
+
+            switch (role_[i]) {
+                case DOC:
+                    num_doc_ = i;
+                    break;
+                case COMA:
+                    num_coma_ = i;
+                    break;
+                case MANA:
+                    num_mana_ = i;
+                    break;
+            }
+        }
+
+        votes_.assign(N_, 0);
+        checked_.assign(N_, false);
+        unchecked_live_ = N_ - 1;
+    }
+
+    int days(void) const {
+        return day_ - 1;
+    }
+
+    // plays until someone wins or max_days pass (0 - no limit), prints every
+    // report-th day; returns the winner, 0 if stopped by max_days
+    int play(const int &max_days, const int &report) {
+        while (max_days <= 0 || day_ <= max_days) {
+            kick_ = -1;
+            int state_res = night();
+
+            if (!state_res)
+                state_res = day();
+
+            if (report > 0 && (day_ % report == 0 || state_res))
+                print_day();
+
+            ++day_;
+
+            if (state_res)
+                return state_res;
+        }
+
+        return 0;
+    }
+
+    size_t bytes_per_seat(void) const {
+        size_t bytes = role_.capacity() * sizeof(uint8_t) +
+            live_list_.capacity() * sizeof(int) +
+            pos_.capacity() * sizeof(int) +
+            votes_.capacity() * sizeof(int) +
+            touched_.capacity() * sizeof(int) +
+            coma_q_.capacity() * sizeof(int) +
+            checked_.capacity() / 8;
+
+        return bytes / N_;
+    }
+};
+
+void run_lobby(const int &N, const int &mafia_count, const int &max_days, const int &report) {
+    using clock = std::chrono::steady_clock;
+
+    auto begin = clock::now();
+    Lobby lobby(N, mafia_count, std::random_device{}());
+    double setup = std::chrono::duration<double>(clock::now() - begin).count();
+
+    std::cout << "Lobby " << N << " seats, " << mafia_count << " mafia, setup "
+        << setup << " s\n";
+    std::cout.flush();
+
+    begin = clock::now();
+    int state_res = lobby.play(max_days, report);
+    double sec = std::chrono::duration<double>(clock::now() - begin).count();
+
+    switch (state_res) {
+        case 0:
+            std::cout << "No winner after " << lobby.days() << " days\n";
+            break;
+        case 1:
+            std::cout << "Civillian win\n";
+            break;
+        case 2:
+            std::cout << "Mafia win\n";
+            break;
+        case 3:
+            std::cout << "Mana win\n";
+            break;
+    }
+
+    std::cout << "Days " << lobby.days() << ", " << sec << " s, "
+        << lobby.bytes_per_seat() << " bytes per seat\n";
+    std::cout.flush();
+}
@@ -1,15 +1,450 @@
-#include "players.hpp"
+#include "barrier.hpp"
+#include "cache.hpp"
+#include "cfr.hpp"
+#include "daemon.hpp"
+#include "duel.hpp"
+#include "evolve.hpp"
+#include "game.hpp"
+#include "lanes.hpp"
+#include "league.hpp"
+#include "lobby.hpp"
+#include "pair.hpp"
+#include "script.hpp"
+#include "tournament.hpp"
 #include <algorithm>
 #include <iostream>
 #include <iterator>
 #include <random>
 #include <vector>
 
+// Takes docs=, comas=, manas=, plugin=role:path, seat=num:path,
+// policy=path and early=1 out of the arguments, the rest keep their places
+void role_counts(int &argc, char **argv, Config &conf) {
+    std::map<std::string, int> roles = {
+        {"civilian", CIVILIAN}, {"doc", DOC}, {"coma", COMA}, {"mana", MANA}, {"mafia", MAFIA}};
+    int n = 1;
+
+    for (int i = 1; i < argc; ++i) {
+        std::string a = argv[i];
+        size_t colon = a.find(':');
+
+        if ((a.rfind("plugin=", 0) == 0 || a.rfind("seat=", 0) == 0) && colon != std::string::npos) {
+            std::string who = a.substr(a.find('=') + 1, colon - a.find('=') - 1);
+            auto plugin = Plugin::load(a.substr(colon + 1));
+
+            if (!plugin)
+                exit(1);
+
+            if (a[0] == 's')
+                conf.seat_plugin_[atoi(who.c_str())] = plugin;
+            else if (roles.count(who))
+                conf.plugin_[roles[who]] = plugin;
+            else {
+                printf("Unknown role %s\n", who.c_str());
+                exit(1);
+            }
+        } else if (a.rfind("policy=", 0) == 0) {
+            auto pol = std::make_shared<Policy>();
+
+            if (!pol->load(argv[i] + 7)) {
+                printf("Can't load the policy %s\n", argv[i] + 7);
+                exit(1);
+            }
+            conf.policy_ = pol;
+        } else if (a.rfind("docs=", 0) == 0)
+            conf.doc_count_ = atoi(argv[i] + 5);
+        else if (a.rfind("comas=", 0) == 0)
+            conf.coma_count_ = atoi(argv[i] + 6);
+        else if (a.rfind("manas=", 0) == 0)
+            conf.mana_count_ = atoi(argv[i] + 6);
+        else if (a.rfind("early=", 0) == 0)
+            conf.early_end_ = atoi(argv[i] + 6);
+        else
+            argv[n++] = argv[i];
+    }
+
+    argc = n;
+}
+
+// Takes name=value out of the arguments, "" if it isn't there
+std::string take_arg(int &argc, char **argv, const std::string &name) {
+    std::string res;
+    int n = 1;
+
+    for (int i = 1; i < argc; ++i) {
+        if (std::string(argv[i]).rfind(name + "=", 0) == 0)
+            res = argv[i] + name.size() + 1;
+        else
+            argv[n++] = argv[i];
+    }
+
+    argc = n;
+    return res;
+}
+
+// Sets the lobby of N seats and N / k mafia, aborts if it can't be played;
+// builds its Forced_table for early=1
+void lobby_size(Config &conf, const int &N, const int &k) {
+    if (k < 3 || N / k == 0)
+        abort();
+
+    conf.N_ = N;
+    conf.mafia_count_ = N / k;
+    if (!conf.valid())
+        abort();
+
+    if (conf.early_end_ && !build_forced(conf))
+        printf("No early end for plugins or a lobby this large, the games are played out\n");
+}
+
 int 
 main(int argc, char **argv) 
 {
     std::srand(std::time(nullptr));
 
+    // MAFIA_TRACE=file.json writes a trace-event timeline of the run
+    const char *trace_path = getenv("MAFIA_TRACE");
+    if (trace_path)
+        tracer().enable();
+
+    // MAFIA_FEED=name publishes the game events to the shared memory ring
+    // of that name, `mafia watch name` follows it
+    const char *feed_name = getenv("MAFIA_FEED");
+    if (feed_name && !feed().open(feed_name))
+        printf("Can't open the feed %s\n", feed_name);
+
+    if (argc > 1 && std::string(argv[1]) == "pool") {
+        Config conf{};
+        std::string arch_dir = take_arg(argc, argv, "archive");
+
+        role_counts(argc, argv, conf);
+
+        if (argc < 5) {
+            printf("Usage: %s pool games N k [in_flight] [threads] [results] [seed]"
+                " [docs=1] [comas=1] [manas=1] [plugin=role:path.so] [seat=num:path.so]"
+                " [archive=dir] [early=1]\n", argv[0]);
+            return 1;
+        }
+
+        lobby_size(conf, atoi(argv[3]), atoi(argv[4]));
+
+        uint64_t seed = argc > 8 ? strtoull(argv[8], nullptr, 10) : std::random_device{}();
+        std::unique_ptr<Results_writer> out;
+
+        if (argc > 7) {
+            out = std::make_unique<Results_writer>(argv[7]);
+            if (!out->good())
+                abort();
+        }
+
+        std::unique_ptr<Archive_writer> arch;
+
+        if (!arch_dir.empty()) {
+            arch = std::make_unique<Archive_writer>(arch_dir);
+            if (!arch->good())
+                abort();
+        }
+
+        {
+            Pool pool(argc > 6 ? atoi(argv[6]) : 0);
+            run_games(pool, atoll(argv[2]), conf, argc > 5 ? atoi(argv[5]) : 0, seed, out.get(), arch.get());
+        }
+        out.reset();
+        arch.reset();
+
+        if (trace_path)
+            tracer().flush(trace_path);
+        return 0;
+    }
+
+    if (argc > 1 && std::string(argv[1]) == "tournament") {
+        Config conf{};
+
+        role_counts(argc, argv, conf);
+
+        if (argc < 5) {
+            printf("Usage: %s tournament games N k [workers] [threads] [seed]"
+                " [docs=1] [comas=1] [manas=1] [plugin=role:path.so] [seat=num:path.so]\n", argv[0]);
+            return 1;
+        }
+
+        lobby_size(conf, atoi(argv[3]), atoi(argv[4]));
+
+        uint64_t seed = argc > 7 ? strtoull(argv[7], nullptr, 10) : std::random_device{}();
+
+        return run_tournament(atoll(argv[2]), conf, argc > 5 ? atoi(argv[5]) : 0,
+            argc > 6 ? atoi(argv[6]) : 1, seed) ? 1 : 0;
+    }
+
+    if (argc > 1 && (std::string(argv[1]) == "duel" || std::string(argv[1]) == "pair")) {
+        Config a{};
+        bool pair = std::string(argv[1]) == "pair";
+
+        role_counts(argc, argv, a);
+
+        if (argc < 5) {
+            printf("Usage: %s duel N k role=strategy [delta] [max_games] [threads] [seed]"
+                " [docs=1] [comas=1] [manas=1] [plugin=role:path.so] [seat=num:path.so] [policy=path]\n", argv[0]);
+            printf("       %s pair N k role=strategy [games] [threads] [seed] [docs=1]..."
+                " - the spread of the difference unpaired and paired\n", argv[0]);
+            printf("roles civilian, doc, coma, mafia; strategies base, suspect (civilian), self (doc),"
+                " check (coma), focus (mafia), tuned (with the default chances), policy (with policy=path)\n");
+            return 1;
+        }
+
+        lobby_size(a, atoi(argv[2]), atoi(argv[3]));
+
+        std::string spec = argv[4];
+        size_t eq = spec.find('=');
+        std::map<std::string, int> roles = {{"civilian", CIVILIAN}, {"doc", DOC}, {"coma", COMA}, {"mafia", MAFIA}};
+
+        if (eq == std::string::npos || !roles.count(spec.substr(0, eq)) ||
+                !name_to_strategy.count(spec.substr(eq + 1))) {
+            printf("Unknown role=strategy %s\n", argv[4]);
+            return 1;
+        }
+
+        int role = roles[spec.substr(0, eq)];
+        Config b = a;
+        b.strategy_[role] = name_to_strategy[spec.substr(eq + 1)];
+
+        if (pair) {
+            uint64_t seed = argc > 7 ? strtoull(argv[7], nullptr, 10) : std::random_device{}();
+
+            Pool pool(argc > 6 ? atoi(argv[6]) : 0);
+            run_paired(pool, a, b, role == MAFIA ? 2 : 1, argc > 5 ? atoll(argv[5]) : 100000, seed);
+            return 0;
+        }
+
+        uint64_t seed = argc > 8 ? strtoull(argv[8], nullptr, 10) : std::random_device{}();
+
+        Pool pool(argc > 7 ? atoi(argv[7]) : 0);
+        run_duel(pool, a, b, role == MAFIA ? 2 : 1, argc > 5 ? atof(argv[5]) : 0.02,
+            argc > 6 ? atoll(argv[6]) : 1000000, seed);
+        return 0;
+    }
+
+    if (argc > 1 && std::string(argv[1]) == "evolve") {
+        Config conf{};
+
+        role_counts(argc, argv, conf);
+
+        if (argc < 5 || (std::string(argv[4]) != "mafia" && std::string(argv[4]) != "civilian")) {
+            printf("Usage: %s evolve N k mafia|civilian [budget] [threads] [seed]"
+                " [docs=1] [comas=1] [manas=1]\n", argv[0]);
+            return 1;
+        }
+
+        lobby_size(conf, atoi(argv[2]), atoi(argv[3]));
+
+        uint64_t seed = argc > 7 ? strtoull(argv[7], nullptr, 10) : std::random_device{}();
+
+        Pool pool(argc > 6 ? atoi(argv[6]) : 0);
+        run_evolve(pool, conf, std::string(argv[4]) == "mafia" ? MAFIA : CIVILIAN,
+            argc > 5 ? atoll(argv[5]) : 1000000, seed);
+        return 0;
+    }
+
+    if (argc > 1 && std::string(argv[1]) == "cfr") {
+        Config conf{};
+        std::string out = take_arg(argc, argv, "out");
+
+        role_counts(argc, argv, conf);
+
+        if (argc < 4) {
+            printf("Usage: %s cfr N k [games] [threads] [seed] [docs=1] [comas=1] [manas=1]"
+                " [out=policy.txt]\n", argv[0]);
+            printf("the strategy tables of every role for small lobbies, N <= %d;"
+                " play them with role=policy policy=policy.txt\n", Policy::lives_ - 1);
+            return 1;
+        }
+
+        lobby_size(conf, atoi(argv[2]), atoi(argv[3]));
+
+        uint64_t seed = argc > 6 ? strtoull(argv[6], nullptr, 10) : std::random_device{}();
+
+        Pool pool(argc > 5 ? atoi(argv[5]) : 0);
+        run_cfr(pool, conf, argc > 4 ? atoll(argv[4]) : 1000000, seed, out);
+        return 0;
+    }
+
+    if (argc > 1 && std::string(argv[1]) == "serve") {
+        std::string dir = take_arg(argc, argv, "cache");
+
+        if (argc < 3) {
+            printf("Usage: %s serve socket [threads] [cache=dir]\n", argv[0]);
+            printf("then %s ask socket run [prio=0] [games=10000] [seed=0] [N=20,...] [k=3,...]"
+                " [docs=1,...] [comas=1,...] [manas=1,...] [role=strategy]... [plugin=role:path]"
+                " [policy=path] [early=1] [out=file] | cancel id | jobs | shutdown\n", argv[0]);
+            return 1;
+        }
+
+        Daemon daemon(argv[2], argc > 3 ? atoi(argv[3]) : 0, dir);
+        return daemon.run() ? 0 : 1;
+    }
+
+    if (argc > 1 && std::string(argv[1]) == "ask") {
+        if (argc < 4) {
+            printf("Usage: %s ask socket request...\n", argv[0]);
+            return 1;
+        }
+
+        std::string request;
+        for (int i = 3; i < argc; ++i)
+            request += (i > 3 ? " " : "") + std::string(argv[i]);
+
+        return daemon_ask(argv[2], request) ? 0 : 1;
+    }
+
+    if (argc > 1 && std::string(argv[1]) == "league") {
+        Config conf{};
+
+        role_counts(argc, argv, conf);
+
+        if (argc < 4) {
+            printf("Usage: %s league N k [games] [threads] [seed]"
+                " [docs=1] [comas=1] [manas=1] [plugin=role:path.so]\n", argv[0]);
+            return 1;
+        }
+
+        lobby_size(conf, atoi(argv[2]), atoi(argv[3]));
+
+        // plugins are entrants here, not the players of their role
+        std::vector<std::pair<int, std::shared_ptr<Plugin>>> plugins;
+        for (int r = CIVILIAN; r <= MAFIA; ++r) {
+            if (conf.plugin_[r] && r != MANA)
+                plugins.push_back({r, conf.plugin_[r]});
+            conf.plugin_[r] = nullptr;
+        }
+
+        uint64_t seed = argc > 6 ? strtoull(argv[6], nullptr, 10) : std::random_device{}();
+
+        Pool pool(argc > 5 ? atoi(argv[5]) : 0);
+        run_league(pool, conf, plugins, argc > 4 ? atoll(argv[4]) : 200000, seed);
+        return 0;
+    }
+
+    if (argc > 1 && std::string(argv[1]) == "scan") {
+        if (argc < 4) {
+            printf("Usage: %s scan results column [column]\n", argv[0]);
+            return 1;
+        }
+
+        return scan_results(argv[2], std::vector<std::string>(argv + 3, argv + argc)) ? 0 : 1;
+    }
+
+    if (argc > 1 && std::string(argv[1]) == "query") {
+        if (argc < 3) {
+            printf("Usage: %s query archive [field=value | field=lo..hi]...\n", argv[0]);
+            return 1;
+        }
+
+        return query_archive(argv[2], std::vector<std::string>(argv + 3, argv + argc)) ? 0 : 1;
+    }
+
+    if (argc > 1 && std::string(argv[1]) == "watch") {
+        watch_feed(argc > 2 ? argv[2] : "/mafia_feed", argc > 3 ? atoll(argv[3]) : 0);
+        return 1;
+    }
+
+    if (argc > 1 && std::string(argv[1]) == "lanes") {
+        if (argc < 5) {
+            printf("Usage: %s lanes games N k [threads]\n", argv[0]);
+            return 1;
+        }
+
+        // one doc, coma and mana, as Lanes deals them, a seat per bit
+        Config conf{};
+        lobby_size(conf, atoi(argv[3]), atoi(argv[4]));
+        if (conf.N_ > 64)
+            abort();
+
+        Pool pool(argc > 5 ? atoi(argv[5]) : 0);
+        run_lanes(pool, atoll(argv[2]), conf.N_, conf.mafia_count_);
+        return 0;
+    }
+
+    if (argc > 1 && std::string(argv[1]) == "barrier") {
+        std::vector<int> sizes;
+
+        for (int i = 2; i < argc; ++i)
+            sizes.push_back(atoi(argv[i]));
+        if (sizes.empty())
+            sizes = {64, 1000, 10000};
+
+        bench_barriers(sizes);
+        return 0;
+    }
+
+    if (argc > 1 && std::string(argv[1]) == "cached") {
+        Config conf{};
+
+        role_counts(argc, argv, conf);
+
+        if (argc < 6) {
+            printf("Usage: %s cached dir games N k [threads] [seed]"
+                " [docs=1] [comas=1] [manas=1] [plugin=role:path.so] [seat=num:path.so]\n", argv[0]);
+            return 1;
+        }
+
+        lobby_size(conf, atoi(argv[4]), atoi(argv[5]));
+
+        Pool pool(argc > 6 ? atoi(argv[6]) : 0);
+        run_cached(pool, argv[2], conf, atoll(argv[3]), argc > 7 ? strtoull(argv[7], nullptr, 10) : 0);
+        return 0;
+    }
+
+    if (argc > 1 && std::string(argv[1]) == "script") {
+        Config conf{};
+        std::string out = take_arg(argc, argv, "out");
+        std::string open = take_arg(argc, argv, "open");
+
+        role_counts(argc, argv, conf);
+
+        if (argc < 5) {
+            printf("Usage: %s script N k file|- [games] [humans] [seed]"
+                " [open=y] [out=path] [docs=1] [comas=1] [manas=1]\n", argv[0]);
+            printf("answers: a seat number for a vote, a doc, a mana or a mafia, kill N or check N"
+                " for a coma, a mafia may also say text\n");
+            return 1;
+        }
+
+        lobby_size(conf, atoi(argv[2]), atoi(argv[3]));
+
+        std::ifstream file(argv[4]);
+        if (std::string(argv[4]) != "-" && !file) {
+            printf("Can't read %s\n", argv[4]);
+            return 1;
+        }
+
+        auto lines = Script_input::load(std::string(argv[4]) == "-" ? std::cin : file);
+        if (lines->empty()) {
+            printf("Empty script\n");
+            return 1;
+        }
+
+        int humans = std::clamp(argc > 6 ? atoi(argv[6]) : 1, 0, conf.N_);
+        uint64_t seed = argc > 7 ? strtoull(argv[7], nullptr, 10) : std::random_device{}();
+
+        run_script(conf, lines, argc > 5 ? atoll(argv[5]) : 1000, humans, seed,
+            open == "y", out.empty() ? "/dev/null" : out);
+        return 0;
+    }
+
+    if (argc > 1 && std::string(argv[1]) == "lobby") {
+        if (argc < 4) {
+            printf("Usage: %s lobby N k [max_days] [report_every]\n", argv[0]);
+            return 1;
+        }
+
+        // one doc, coma and mana, as Lobby deals them
+        Config conf{};
+        lobby_size(conf, atoi(argv[2]), atoi(argv[3]));
+
+        run_lobby(conf.N_, conf.mafia_count_, argc > 4 ? atoi(argv[4]) : 0, argc > 5 ? atoi(argv[5]) : 0);
+        return 0;
+    }
+
     int N, k;
     bool gamer, op_cl_info;
     char c_gamer, c_op_cl_info;
@@ -33,49 +468,23 @@ main(int argc, char **argv)
     if (mafia_count == 0)
         abort();
 
-    std::vector<int> pers(N, 0);
-    pers[0] = DOC; pers[1] = COMA; pers[2] = MANA;
-    for (int i = 3; i < 3 + mafia_count; ++i) 
-        pers[i] = MAFIA;
-    for (int i = 3 + mafia_count; i < N; ++i)
-        pers[i] = CIVILIAN;
-
-    std::random_device rd;
-    std::mt19937 g(rd());
- 
-    std::shuffle(pers.begin(), pers.end(), g);
-
-    Shared_ptr<Data> data = new Data(N, mafia_count);
-    Shared_ptr<Coma_to_host> coma_to_host = new Coma_to_host();
-    Shared_ptr<Mana_to_host> mana_to_host = new Mana_to_host();
-    Shared_ptr<Doc_to_host> doc_to_host = new Doc_to_host();
-    Shared_ptr<Mafia_privat> mafia_privat = new Mafia_privat(mafia_count);
-
-    std::promise<int> p_doc, p_mana;
-    std::shared_future<int> f_doc = p_doc.get_future(), f_mana = p_mana.get_future();
-
-    std::vector<Player*> players_struct;
-    Host host = Host(
-        data, 
-        coma_to_host, 
-        mana_to_host, 
-        doc_to_host,
-        mafia_privat, 
-        pers,
-        f_doc,
-        f_mana,
-        op_cl_info
-    );
-
-    std::set<int> maf_bro;
-
-    for (int i = 0; i < N; ++i) 
-        if (pers[i] == MAFIA) {
-            maf_bro.insert(i);
-        }
+    uint64_t seed = std::random_device{}();
+    Rng g(seed);
+
+    Config conf{};
+    conf.N_ = N;
+    conf.mafia_count_ = mafia_count;
+    if (!conf.valid())
+        abort();
+
+    std::vector<int> pers = deal_roles(conf, g);
+
+    Roster maf_bro(pers, MAFIA);
+
+    int random_number = -1;
 
     if (gamer) {
-        int random_number = std::experimental::randint(0, int(N-1));
+        random_number = std::experimental::randint(0, int(N-1));
 
         std::cout << "Your number is "<< random_number << "\n";
         std::cout << "You are " << num_to_role[pers[random_number]] << "\n";
@@ -83,84 +492,27 @@ main(int argc, char **argv)
         if (num_to_role[pers[random_number]] == "MAFIA") {
             std::cout << "Your maf bro: \n";
 
-            for (auto i : maf_bro) 
+            for (auto i : maf_bro.seats())
                 if (i != random_number)
                     std::cout << i << " ";
 
             std::cout << "\n";
             std::cout.flush();
         }
-
-        for (int i = 0; i < N; ++i) {
-            if (i == random_number) {
-                switch (pers[i]) {
-                    case CIVILIAN:
-                        players_struct.push_back(static_cast<Player*>(new Civilian_cmd(i, data)));
-                        break;
-                    case DOC:
-                        players_struct.push_back(static_cast<Player*>(new Doc_cmd(i, data, doc_to_host)));
-                        break;
-                    case COMA:
-                        players_struct.push_back(static_cast<Player*>(new Coma_cmd(i, data, coma_to_host)));
-                        break;
-                    case MANA:
-                        players_struct.push_back(static_cast<Player*>(new Mana_cmd(i, data, mana_to_host)));
-                        break;
-                    case MAFIA:
-                        players_struct.push_back(static_cast<Player*>(new Mafia_cmd(i, data, mafia_privat, maf_bro)));
-                        break;
-                }
-            } else {
-                switch (pers[i]) {
-                    case CIVILIAN:
-                        players_struct.push_back(static_cast<Player*>(new Civilian(i, data)));
-                        break;
-                    case DOC:
-                        players_struct.push_back(static_cast<Player*>(new Doc(i, data, doc_to_host)));
-                        break;
-                    case COMA:
-                        players_struct.push_back(static_cast<Player*>(new Coma(i, data, coma_to_host)));
-                        break;
-                    case MANA:
-                        players_struct.push_back(static_cast<Player*>(new Mana(i, data, mana_to_host)));
-                        break;
-                    case MAFIA:
-                        players_struct.push_back(static_cast<Player*>(new Mafia(i, data, mafia_privat, maf_bro)));
-                        break;
-                }
-            }
-        }
-    } else {
-        for (int i = 0; i < N; ++i) {
-            switch (pers[i]) {
-                case CIVILIAN:
-                    players_struct.push_back(static_cast<Player*>(new Civilian(i, data)));
-                    break;
-                case DOC:
-                    players_struct.push_back(static_cast<Player*>(new Doc(i, data, doc_to_host)));
-                    break;
-                case COMA:
-                    players_struct.push_back(static_cast<Player*>(new Coma(i, data, coma_to_host)));
-                    break;
-                case MANA:
-                    players_struct.push_back(static_cast<Player*>(new Mana(i, data, mana_to_host)));
-                    break;
-                case MAFIA:
-                    players_struct.push_back(static_cast<Player*>(new Mafia(i, data, mafia_privat, maf_bro)));
-                    break;
-            }
-        }
     }
 
-    std::vector<std::thread> t;
+    std::vector<bool> cmd(N, false);
+    if (gamer)
+        cmd[random_number] = true;
 
-    std::thread th{&Host::host_loop, host};
+    if (getenv("MAFIA_LATENCY"))
+        cmd_io().enable(N);
 
-    for (int i = 0; i < N; ++i) 
-        t.push_back(std::thread {&Player::game_loop, players_struct[i]});
+    play_threaded(conf, pers, cmd, seed, op_cl_info);
 
-    th.join();
+    if (cmd_io().on())
+        cmd_io().print(std::cout);
 
-    for (int i = 0; i < N; ++i)
-        t[i].join();
+    if (trace_path)
+        tracer().flush(trace_path);
 }
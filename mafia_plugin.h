@@ -0,0 +1,64 @@
+/*
+ * C ABI of bot strategy plugins. A plugin is a shared object exporting
+ *
+ *     const mafia_plugin *mafia_plugin_get(void);
+ *
+ * The engine makes one state per game and group of seats it controls (the
+ * seats of one role given to the plugin) and calls decide once per phase
+ * with all live seats of the group, so a plugin decides for them in one go.
+ *
+ * Build: cc -O2 -shared -fPIC -I. plugins/random_bot.c -o random_bot.so
+ */
+#ifndef MAFIA_PLUGIN_H
+#define MAFIA_PLUGIN_H
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define MAFIA_PLUGIN_ABI 1
+
+/* roles, the values of Roles in players.hpp */
+#define MAFIA_CIVILIAN 0
+#define MAFIA_DOC      1
+#define MAFIA_COMA     2
+#define MAFIA_MANA     3
+#define MAFIA_MAFIA    4
+
+#define MAFIA_NIGHT 0
+#define MAFIA_DAY   1
+
+typedef struct mafia_view {
+    int n;                  /* seats */
+    int day;
+    int phase;              /* MAFIA_NIGHT or MAFIA_DAY */
+    int role;               /* of the seats asked for */
+    const uint8_t *live;    /* n entries, 1 - live */
+    const uint8_t *mafia;   /* n entries for the mafia, NULL for the others */
+} mafia_view;
+
+typedef struct mafia_move {
+    int target;             /* seat, -1 - nothing (a random vote by day) */
+    int check;              /* Coma at night: 1 - check, 0 - kill */
+} mafia_move;
+
+typedef struct mafia_plugin {
+    int abi;                /* MAFIA_PLUGIN_ABI */
+    const char *name;
+    void *(*create)(int n, uint64_t seed);
+    void (*destroy)(void *state);
+    /* out[i] is the move of seats[i] */
+    void (*decide)(void *state, const mafia_view *view, int count, const int *seats, mafia_move *out);
+    /* answer to a Coma check, may be NULL */
+    void (*learn)(void *state, int seat, int target, int is_mafia);
+} mafia_plugin;
+
+typedef const mafia_plugin *(*mafia_plugin_get_t)(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
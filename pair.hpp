@@ -0,0 +1,78 @@
+#pragma once
+
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <iostream>
+
+#include "duel.hpp"
+
+// How much the pairing of a duel is worth. The same games of A and B are
+// measured three ways: as if A and B were played on seeds of their own
+// (the variance of the difference is then the sum of the two), paired by
+// the deal only, and paired by the deal and by the draws of every seat and
+// phase (Config::crn_). For each the difference of the win rates of the
+// side, its 95% interval, and how many independent games the same
+// interval would take. Above game_grain_ seats the draws don't pair a
+// game with itself, that row is left out.
+
+struct Pair_row
+{
+    const char *name_;
+    double mean_;
+    double var_;   // of one pair
+};
+
+void run_paired(Pool &pool,
+    Config a,
+    Config b,
+    const int &side,
+    const long long &games,
+    const uint64_t &seed)
+{
+    using clock = std::chrono::steady_clock;
+
+    Duel_stats deal, crn;
+    auto begin = clock::now();
+
+    bool draws = a.N_ <= game_grain_;
+
+    a.crn_ = b.crn_ = false;
+    play_pairs(pool, a, b, side, games, seed, deal);
+    if (draws) {
+        a.crn_ = b.crn_ = true;
+        play_pairs(pool, a, b, side, games, seed, crn);
+    }
+
+    double sec = std::chrono::duration<double>(clock::now() - begin).count();
+
+    const Duel_stats &all = draws ? crn : deal;
+    double pa = double(all.win_a_) / all.n_;
+    double pb = double(all.win_b_) / all.n_;
+    double var_ind = pa * (1 - pa) + pb * (1 - pb);
+
+    Pair_row rows[] = {
+        {"independent", pb - pa, var_ind},
+        {"same deal", deal.mean(), deal.var()},
+        {"same deal, draws", crn.mean(), crn.var()},
+    };
+
+    std::cout << "Pairs " << games << " on seed " << seed << ", side " << side
+        << ": A " << pa << " B " << pb << "\n";
+    std::cout << "pairing                diff     +-95%   var/pair   pairs for the +- of independent\n";
+
+    for (auto &r : rows) {
+        if (&r == rows + 2 && !draws)
+            break;
+
+        char line[128];
+        snprintf(line, sizeof(line), "%-18s %9.4f %9.4f %10.4f %12.0f (%.1fx fewer)\n", r.name_, r.mean_,
+            1.96 * std::sqrt(r.var_ / games), r.var_, games * r.var_ / var_ind,
+            r.var_ > 0 ? var_ind / r.var_ : 0.0);
+        std::cout << line;
+    }
+
+    std::cout << "Time " << sec << " s, " << (draws ? 4 : 2) * games / sec << " games/s\n";
+    std::cout.flush();
+}
@@ -1,8 +1,12 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
 #include <cstdlib>
 #include <ctime>
 #include <experimental/random>
 #include <mutex>
-#include <barrier>
 #include <memory>
 #include <future>
 #include <queue>
@@ -10,7 +14,15 @@
 #include <syncstream>
 #include <map>
 
+#include "barrier.hpp"
+#include "cmd_io.hpp"
+#include "feed.hpp"
+#include "forced.hpp"
+#include "policy.hpp"
+#include "roster.hpp"
 #include "shared_ptr.hpp"
+#include "suspicion.hpp"
+#include "trace.hpp"
 
 enum Roles
 {
@@ -21,6 +33,98 @@ enum Roles
     MAFIA,
 };
 
+// Bump when any bot or the rules play differently: cached results of the
+// old build are not used then
+const int strategy_version_ = 3;
+
+// Bot behaviours other than the original one, each for one role
+enum Strategies
+{
+    STRAT_BASE,
+    STRAT_SELF,  // Doc saves itself whenever it may
+    STRAT_CHECK, // Coma checks until it finds a mafia
+    STRAT_FOCUS, // Mafia votes with the bros
+    STRAT_TUNED, // any role, by Bot_params
+    STRAT_SUSPECT, // Civilian votes the most suspect seat of Suspicion
+    STRAT_POLICY, // any role, by the tables of Policy
+};
+
+std::map<std::string, int> name_to_strategy = {
+    {"base", STRAT_BASE},
+    {"self", STRAT_SELF},
+    {"check", STRAT_CHECK},
+    {"focus", STRAT_FOCUS},
+    {"tuned", STRAT_TUNED},
+    {"suspect", STRAT_SUSPECT},
+    {"policy", STRAT_POLICY},
+};
+
+// The chances behind the choices of the STRAT_TUNED bots, all in [0, 1].
+// The defaults are the base bots.
+struct Bot_params
+{
+    static const int size_ = 5;
+
+    double p_[size_] = {0, 0, 0.5, 1, 0};
+
+    enum {
+        HERD,        // any seat: vote with the most voted seat so far
+        DOC_SELF,    // Doc: save itself when it may
+        COMA_CHECK,  // Coma: check rather than kill
+        COMA_FOLLOW, // Coma: vote for a mafia it found
+        MAFIA_FOCUS, // Mafia: vote with the bros
+    };
+
+    double operator[](const int &i) const {
+        return p_[i];
+    }
+};
+
+const char *bot_param_names[Bot_params::size_] = {
+    "herd", "doc_self", "coma_check", "coma_follow", "mafia_focus"
+};
+
+// splitmix64, small enough to give every seat its own stream so a game
+// is replayed exactly from its seed whatever thread runs it
+struct Rng
+{
+    using result_type = uint64_t;
+
+    uint64_t s_;
+
+    Rng (const uint64_t &seed = 0, const uint64_t &stream = 0) :
+        s_(seed ^ ((stream + 1) * 0xd1b54a32d192ed03ull))
+    {
+        next();
+    }
+
+    uint64_t next(void) {
+        uint64_t z = (s_ += 0x9e3779b97f4a7c15ull);
+        z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+        z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+        return z ^ (z >> 31);
+    }
+
+    // in [0, 1)
+    double uniform(void) {
+        return (next() >> 11) * 0x1.0p-53;
+    }
+
+    // in [a, b]
+    int randint(const int &a, const int &b) {
+        return a + int(next() % uint64_t(b - a + 1));
+    }
+
+    static constexpr uint64_t min(void) { return 0; }
+    static constexpr uint64_t max(void) { return ~uint64_t(0); }
+    uint64_t operator()(void) { return next(); }
+
+    // the stream of one seat in one phase of a game
+    static Rng phase(const uint64_t &seed, const int &phase, const uint64_t &stream) {
+        return Rng(Rng(seed, phase).next(), stream);
+    }
+};
+
 std::map<int, std::string> num_to_role = {
     {0, "CIVILLIAN"}, 
     {1, "DOC"},
@@ -34,14 +138,20 @@ struct Data
     int N_;
     int mafia_count_;
     std::vector<bool> is_live_;
-    std::mutex *mut_state_;
-    std::mutex *mut_theme_;
+    std::shared_ptr<std::mutex> mut_state_;
+    std::shared_ptr<std::mutex> mut_theme_;
     int theme_;
     std::vector<int> vote_list_;
-    std::mutex *mut_vote_;
-    std::barrier<> *bar_vote_;
-    std::barrier<> *bar_res_d_;
-    std::barrier<> *bar_res_n_;
+    std::vector<int> last_vote_;       // vote_list_ of the last day, for the night
+    std::shared_ptr<std::mutex> mut_vote_;
+    std::shared_ptr<Tree_barrier> bar_vote_;
+    std::shared_ptr<Tree_barrier> bar_res_d_;
+    std::shared_ptr<Tree_barrier> bar_act_n_;
+    std::shared_ptr<Tree_barrier> bar_res_n_;
+    std::shared_ptr<Suspicion> susp_;  // if a bot needs it, kept by the host
+    bool crn_{false};                  // every phase draws from a stream of its own
+    std::shared_ptr<Policy_learn> learn_;  // while a Policy is learned
+    std::shared_ptr<const Forced_table> forced_;  // of the lobby, set - end a game once its winner is forced
 
     Data (const int &N, const int &mafia_count) : 
         N_(N), 
@@ -49,129 +159,351 @@ struct Data
     {
         is_live_.resize(N_, 1);
         vote_list_.resize(N_, -1);
+        last_vote_.resize(N_, -1);
         theme_ = -1;
-        bar_vote_ = new std::barrier<>(N_ + 1);
-        bar_res_d_ = new std::barrier<>(N_ + 1);
-        bar_res_n_ = new std::barrier<>(N_ + 1);
-        mut_state_ = new std::mutex;
-        mut_theme_ = new std::mutex;
-        mut_vote_ = new std::mutex;
+        bar_vote_ = std::make_shared<Tree_barrier>(N_ + 1);
+        bar_res_d_ = std::make_shared<Tree_barrier>(N_ + 1);
+        bar_act_n_ = std::make_shared<Tree_barrier>(N_ + 1);
+        bar_res_n_ = std::make_shared<Tree_barrier>(N_ + 1);
+        mut_state_ = std::make_shared<std::mutex>();
+        mut_theme_ = std::make_shared<std::mutex>();
+        mut_vote_ = std::make_shared<std::mutex>();
     }
 };
 
 
-struct Coma_to_host
+// What a Doc, Coma or Mana asks the host for at night
+struct Night_req
 {
-    std::barrier<> *bar_q_c_;
-    std::barrier<> *bar_a_h_;
-    bool type_q_;
-    int q_;
-    bool ans_; // 1 - maf, 0 - civ
-
-    Coma_to_host () {
-        bar_q_c_ = new std::barrier<>(2);
-        bar_a_h_ = new std::barrier<>(2);
-    }
+    int from_;
+    int role_;
+    int type_;   // Coma: 0 - kill, 1 - check
+    int target_;
+    bool ans_;   // answer to a check, 1 - maf, 0 - civ
 };
 
-struct Mana_to_host
+// Batched request channel of all the special roles to the host. A player
+// claims a slot with one fetch_add and fills it before it arrives at
+// Data::bar_act_n_, the host takes the whole batch once that barrier
+// completes and writes the answers in place, they are read back after
+// bar_res_n_. The host clears it between nights, when nobody writes.
+class Host_channel
 {
-    std::barrier<> *bar_q_c_;
-    std::barrier<> *bar_a_h_;
-    int q_;
+    std::vector<Night_req> slots_;
+    std::atomic<size_t> tail_{0};
+
+public:
+    // what submit returns once every slot is taken
+    static const size_t full_ = size_t(-1);
+
+    // pers - roles by seat, one request per special seat and night
+    Host_channel (const std::vector<int> &pers) :
+        slots_(std::count_if(pers.begin(), pers.end(), [](const int &r) {
+            return r == DOC || r == COMA || r == MANA;
+        }))
+    {}
+
+    // Shared_ptr copies what it is given, nobody uses it yet
+    Host_channel (const Host_channel &other) :
+        slots_(other.slots_),
+        tail_(other.tail_.load())
+    {}
+
+    // the slot of the request, where its answer will be, or full_ and
+    // the request is dropped
+    size_t submit(const Night_req &req) {
+        size_t i = tail_.fetch_add(1, std::memory_order_relaxed);
+        if (i >= slots_.size())
+            return full_;
 
-    Mana_to_host() {
-        bar_q_c_ = new std::barrier<>(2);
-        bar_a_h_ = new std::barrier<>(2);
+        slots_[i] = req;
+        return i;
     }
+
+    size_t count(void) const {
+        return std::min(tail_.load(std::memory_order_relaxed), slots_.size());
+    }
+
+    Night_req &operator[](const size_t &i) {
+        return slots_[i];
+    }
+
+    void clear(void) {
+        tail_.store(0, std::memory_order_relaxed);
+    }
+};
+
+struct Maf_msg
+{
+    int from_;
+    char text_[56];
 };
 
-struct Doc_to_host
+// Lock free multi producer queue for one night of mafia talk. A writer
+// claims a slot with one fetch_add and publishes it with a release store,
+// readers take what is published so far. The host clears it between
+// nights, when nobody writes.
+class Maf_chat
 {
-    std::barrier<> *bar_q_c_;
-    std::barrier<> *bar_a_h_;
-    int q_;
+    struct Slot
+    {
+        std::atomic<bool> ready_{false};
+        Maf_msg msg_;
+    };
+
+    std::unique_ptr<Slot[]> slots_;
+    size_t size_;
+    std::atomic<size_t> tail_{0};
+
+public:
+    Maf_chat (const size_t &size) :
+        slots_(new Slot[size]),
+        size_(size)
+    {}
+
+    // false if the night is full
+    bool push(const Maf_msg &msg) {
+        size_t i = tail_.fetch_add(1, std::memory_order_relaxed);
+        if (i >= size_)
+            return false;
+
+        slots_[i].msg_ = msg;
+        slots_[i].ready_.store(true, std::memory_order_release);
+        return true;
+    }
+
+    // the messages from slot `from` on, up to one still being written;
+    // from is moved past them
+    std::vector<Maf_msg> since(size_t &from) const {
+        std::vector<Maf_msg> res;
+        size_t n = std::min(tail_.load(std::memory_order_acquire), size_);
+
+        for (; from < n && slots_[from].ready_.load(std::memory_order_acquire); ++from)
+            res.push_back(slots_[from].msg_);
+
+        return res;
+    }
+
+    void clear(void) {
+        size_t n = std::min(tail_.load(), size_);
 
-    Doc_to_host () {
-        bar_q_c_ = new std::barrier<>(2);
-        bar_a_h_ = new std::barrier<>(2);
+        for (size_t i = 0; i < n; ++i)
+            slots_[i].ready_.store(false, std::memory_order_relaxed);
+        tail_.store(0);
     }
 };
 
 struct Mafia_privat
 {
+    const Roster roster_;   // the mafia seats, for all of them
     int mafia_count_;
-    std::multiset<int> target_;
-    std::set<int> s_target_;
     int tar_;
-    std::mutex *mut_tar_;
-    std::barrier<> *bar_maf_vote_;
-    std::barrier<> *bar_maf_host_;
-
-    Mafia_privat (const int &mafia_count) :
-        mafia_count_(mafia_count) 
+    std::shared_ptr<std::atomic<int>[]> vote_;   // by roster index, -1 none yet
+    std::shared_ptr<Maf_chat> chat_;             // what they say, votes aren't in it
+    std::shared_ptr<Tree_barrier> bar_maf_vote_;
+
+    // pers - roles by seat, the mafia seats meet at bar_maf_vote_ by number
+    Mafia_privat (const std::vector<int> &pers) :
+        roster_(pers, MAFIA),
+        mafia_count_(roster_.size()),
+        vote_(new std::atomic<int>[roster_.size()])
     {
-        bar_maf_vote_ = new std::barrier<>(mafia_count_);
-        bar_maf_host_ = new std::barrier<>(mafia_count_+1);
+        std::vector<bool> mafia(pers.size());
+        for (int i : roster_.seats())
+            mafia[i] = true;
+
+        bar_maf_vote_ = std::make_shared<Tree_barrier>(mafia);
         tar_ = -1;
-        mut_tar_ = new std::mutex;
+        for (int i = 0; i < mafia_count_; ++i)
+            vote_[i].store(-1, std::memory_order_relaxed);
+        // a few lines from everyone
+        chat_ = std::make_shared<Maf_chat>(4 * mafia_count_ + 16);
     }
 
+    // one vote a seat a night, the last one counts
+    void vote(const int &from, const int &target) {
+        int i = roster_.index(from);
+        if (i != -1)
+            vote_[i].store(target, std::memory_order_release);
+    }
+
+    // votes by target, in target order
+    std::map<int, int> votes(void) const {
+        std::map<int, int> count;
+
+        for (int i = 0; i < mafia_count_; ++i) {
+            int t = vote_[i].load(std::memory_order_acquire);
+            if (t != -1)
+                ++count[t];
+        }
+
+        return count;
+    }
+
+    // called by the host once every mafia is done
     void mafia_choice (void) {
-        std::lock_guard<std::mutex> lg{*mut_tar_};
         if (tar_ == -1) {
             int count = 0;
-            for (auto i : s_target_) {
-                if (int(target_.count(i)) > count) {
-                    count = target_.count(i);
-                    tar_ = i;
+            for (auto &i : votes()) {
+                if (i.second > count) {
+                    count = i.second;
+                    tar_ = i.first;
                 }
             }
         }
     }
+
+    void clear(void) {
+        chat_->clear();
+        for (int i = 0; i < mafia_count_; ++i)
+            vote_[i].store(-1, std::memory_order_relaxed);
+        tar_ = -1;
+    }
+};
+
+// Day kicks in Game_rec, next to the night killers MANA, COMA and MAFIA
+const int VOTE = MAFIA + 1;
+
+struct Kill_rec
+{
+    int day_;
+    int killer_;
+    int victim_;
+    int victim_role_;
+};
+
+// What happened in one game, filled in by the host
+struct Game_rec
+{
+    uint64_t seed_{0};
+    int N_{0};
+    int mafia_count_{0};
+    int doc_count_{0};
+    int coma_count_{0};
+    int mana_count_{0};
+    int winner_{0}; //1 - civ, 2 - maf, 3 - man
+    int days_{0};
+    int decided_{0}; // with Data::forced_, the day a forced winner was called, 0 if played out
+    int kills_[VOTE + 1] = {0, 0, 0, 0, 0, 0}; // by killer
+    int saves_{0};
+    int saved_[VOTE + 1] = {0, 0, 0, 0, 0, 0}; // Doc saves by killer
+    std::vector<Kill_rec> kill_list_;
 };
 
 class Host
 {
     Shared_ptr<Data> host_data_;
-    Shared_ptr<Coma_to_host> host_coma_to_host_;
-    Shared_ptr<Mana_to_host> host_mana_to_host_;
-    Shared_ptr<Doc_to_host> host_doc_to_host_;
+    Shared_ptr<Host_channel> host_channel_;
     Shared_ptr<Mafia_privat> host_mafia_privat_;
     std::vector<int> role_for_num_;
     std::shared_future<int> f_doc_;
     std::shared_future<int> f_mana_;
     bool op_cl_info_;
+    bool print_;
     std::set<int> num_civ_;
-    int num_doc_{-1};
-    int num_coma_{-1};
-    int num_mana_{-1};
+    std::set<int> num_doc_;
+    std::set<int> num_coma_;
+    std::set<int> num_mana_;
     std::set<int> num_mafia_;
     std::set<int> now_live_;
+    int day_{1};
+    Rng rng_;
+    Game_rec rec_;
+
+    // called before the victim is marked dead
+    void rec_kill(const int &killer, const int &victim) {
+        if (!host_data_->is_live_[victim])
+            return;
+
+        ++rec_.kills_[killer];
+        rec_.kill_list_.push_back({day_ - 1, killer, victim, role_for_num_[victim]});
+        feed_event(rec_.seed_, day_ - 1, FEED_KILL, killer, victim);
+    }
+
+    int rec_end(const int &state_res) {
+        if (state_res) {
+            rec_.winner_ = state_res;
+            rec_.days_ = day_ - 1;
+            feed_event(rec_.seed_, day_ - 1, FEED_END, state_res);
+        }
+
+        return state_res;
+    }
 
 public:
     Host(Shared_ptr<Data> &host_data, 
-        Shared_ptr<Coma_to_host> &host_coma_to_host, 
-        Shared_ptr<Mana_to_host> &host_mana_to_host, 
-        Shared_ptr<Doc_to_host> &host_doc_to_host, 
+        Shared_ptr<Host_channel> &host_channel, 
         Shared_ptr<Mafia_privat> &host_mafia_privat, 
         std::vector<int> &role_for_num, 
         std::shared_future<int> &f_doc, 
         std::shared_future<int> &f_mana, 
-        bool op_cl_info)
+        bool op_cl_info,
+        bool print = true)
         :
         host_data_(host_data), 
-        host_coma_to_host_(host_coma_to_host), 
-        host_mana_to_host_(host_mana_to_host), 
-        host_doc_to_host_(host_doc_to_host), 
+        host_channel_(host_channel), 
         host_mafia_privat_(host_mafia_privat),
         role_for_num_(role_for_num),
         f_doc_(f_doc),
         f_mana_(f_mana),
-        op_cl_info_(op_cl_info)
+        op_cl_info_(op_cl_info),
+        print_(print)
     {
         for (int i = 0; i < host_data_->N_; ++i)
             now_live_.insert(i);
+
+        rec_.N_ = host_data_->N_;
+        rec_.mafia_count_ = host_data_->mafia_count_;
+
+        /*
+    CIVILIAN,
+    DOC, 
+    COMA,
+    MANA,
+    MAFIA,
+
+         */
+        for (int i = 0; i < (int)role_for_num_.size(); ++i) {
+            switch (role_for_num_[i]) {
+                case CIVILIAN:
+                    num_civ_.insert(i);
+                    break;
+                case DOC:
+                    num_doc_.insert(i);
+                    break;
+                case COMA:
+                    num_coma_.insert(i);
+                    break;
+                case MANA:
+                    num_mana_.insert(i);
+                    break;
+                case MAFIA:
+                    num_mafia_.insert(i);
+                    break;
+            }
+        }
+
+        rec_.doc_count_ = num_doc_.size();
+        rec_.coma_count_ = num_coma_.size();
+        rec_.mana_count_ = num_mana_.size();
+    }
+
+    int day(void) const {
+        return day_;
+    }
+
+    void seed(const uint64_t &seed) {
+        rng_ = Rng(seed, host_data_->N_);
+        rec_.seed_ = seed;
+    }
+
+    void phase_rng(const int &phase) {
+        if (host_data_->crn_)
+            rng_ = Rng::phase(rec_.seed_, phase, host_data_->N_);
+    }
+
+    const Game_rec &rec(void) const {
+        return rec_;
     }
 
     int is_live(const std::set<int> &num) {
@@ -186,19 +518,20 @@ public:
     int state_game(void) { //0 - go, 1 - civ, 2 - maf, 3 - man
         int live_mafia = is_live(num_mafia_);
         int live_civ = is_live(num_civ_);
-        int all_civ = live_civ + host_data_->is_live_[num_doc_] + 
-            host_data_->is_live_[num_coma_] + host_data_->is_live_[num_mana_];
+        int live_mana = is_live(num_mana_);
+        int all_civ = live_civ + is_live(num_doc_) + 
+            is_live(num_coma_) + live_mana;
 
         if (live_mafia > all_civ)
             return 2;
 
-        if (host_data_->is_live_[num_mana_] && live_mafia == all_civ)
+        if (live_mana && live_mafia == all_civ)
             return 0;
 
-        if (!host_data_->is_live_[num_mana_] && live_mafia == all_civ)
+        if (!live_mana && live_mafia == all_civ)
             return 2;
 
-        if (!host_data_->is_live_[num_mana_]) {
+        if (!live_mana) {
             if (!live_mafia)
                 return 1;
         } else {
@@ -209,7 +542,27 @@ public:
         return 0;
     }
 
+    // with Data::forced_, the winner if it is forced before the next phase
+    int forced(const int &next) {
+        if (!host_data_->forced_)
+            return 0;
+
+        int res = host_data_->forced_->decided(is_live(num_mafia_), is_live(num_civ_), is_live(num_doc_),
+            is_live(num_coma_), is_live(num_mana_), next);
+
+        if (res) {
+            rec_.decided_ = day_ - 1;
+            if (print_)
+                std::osyncstream(std::cout) << "Decided on day " << day_ - 1 << "\n";
+        }
+
+        return res;
+    }
+
     void print_res(const int &state_res) {
+        if (!print_)
+            return;
+
         switch (state_res) {
             case 0:
                 break;
@@ -246,7 +599,18 @@ public:
         std::cout.flush();
     }
 
+    void print_live(void) {
+        if (!print_)
+            return;
+
+        std::osyncstream(std::cout) << "Now live\n";
+        for (auto i : now_live_) 
+            std::osyncstream(std::cout) << i << " ";
+        std::osyncstream(std::cout) << "\n\n";
+    }
+
     void vote_res(void) {
+        Trace_scope ts{"vote_res", day_ - 1};
         std::vector<std::pair<int, int>> ms(host_data_->N_, {0, 0});
         for (int i = 0; i < host_data_->N_; ++i) 
             if (host_data_->vote_list_[i] != -1)
@@ -261,161 +625,166 @@ public:
 
         std::unique_lock<std::mutex> uls{*host_data_->mut_state_};
         if (r == 1) {
+            rec_kill(VOTE, ms[0].second);
             host_data_->is_live_[ms[0].second] = 0;
-            std::osyncstream(std::cout) << "Kick " << ms[0].second << "\n";
-            std::cout.flush();
+            if (print_) {
+                std::osyncstream(std::cout) << "Kick " << ms[0].second << "\n";
+                std::cout.flush();
+            }
             now_live_.erase(ms[0].second);
         } else {
-            int random_number = std::experimental::randint(0, int(1));
+            int random_number = rng_.randint(0, int(1));
 
             if (random_number) {
-                int target = std::experimental::randint(0, int(r-1));
+                int target = rng_.randint(0, int(r-1));
+                rec_kill(VOTE, ms[target].second);
                 host_data_->is_live_[ms[target].second] = 0;
-                std::osyncstream(std::cout) << "Kick " << ms[target].second << "\n";
-                std::cout.flush();
+                if (print_) {
+                    std::osyncstream(std::cout) << "Kick " << ms[target].second << "\n";
+                    std::cout.flush();
+                }
 
                 now_live_.erase(ms[target].second);
             } else {
-                std::osyncstream(std::cout) << "No Kick today\n";
-                std::cout.flush();            
-            }
-        }
-        std::osyncstream(std::cout) <<  "\n";
-        std::cout.flush();
-    }
-
-    void host_loop(void) {
-        /*
-    CIVILIAN,
-    DOC, 
-    COMA,
-    MANA,
-    MAFIA,
+                feed_event(rec_.seed_, day_ - 1, FEED_NO_KICK);
 
-         */
-        for (int i = 0; i < (int)role_for_num_.size(); ++i) {
-            switch (role_for_num_[i]) {
-                case CIVILIAN:
-                    num_civ_.insert(i);
-                    break;
-                case DOC:
-                    num_doc_ = i;
-                    break;
-                case COMA:
-                    num_coma_ = i;
-                    break;
-                case MANA:
-                    num_mana_ = i;
-                    break;
-                case MAFIA:
-                    num_mafia_.insert(i);
-                    break;
+                if (print_) {
+                    std::osyncstream(std::cout) << "No Kick today\n";
+                    std::cout.flush();            
+                }
             }
         }
+        if (print_) {
+            std::osyncstream(std::cout) <<  "\n";
+            std::cout.flush();
+        }
+    }
 
-        int day = 1;
+    // The phases below are shared by host_loop and the pool driven Game,
+    // the callers take care of the barriers between them.
 
-        while (true) {
-            int target_doc = -1;
-            int target_coma = -1;
-            int target_mana = -1;
-            int target_mafia = -1;
-            std::osyncstream(std::cout) << "Day " << day << "\n\n";
-            ++day;
+    void night_begin(void) {
+        if (print_) {
+            std::osyncstream(std::cout) << "Day " << day_ << "\n\n";
             std::osyncstream(std::cout) << "Night" << "\n";
             std::cout.flush();
-            std::unique_lock<std::mutex> ul{*host_data_->mut_theme_};
-            
-            host_data_->theme_ = 1;
-
-            ul.unlock();
+        }
+        feed_event(rec_.seed_, day_, FEED_NIGHT, day_);
+        ++day_;
+        phase_rng(2 * (day_ - 2));
+    }
 
-            if (host_data_->is_live_[num_mana_]) {
-                host_mana_to_host_->bar_q_c_->arrive_and_wait();
-                target_mana = host_mana_to_host_->q_; 
-                host_mana_to_host_->bar_a_h_->arrive_and_wait();
+    // all night requests are in, resolve the batch in one pass
+    int night_res(void) {
+        Trace_scope ts{"night_res", day_ - 1};
+        std::vector<int> target_doc;
+        std::vector<int> target_coma;
+        std::vector<int> target_mana;
+        int target_mafia = -1;
+
+        //in seat order, whoever was first to submit
+        {
+            Trace_scope ts{"requests"};
+            std::vector<Night_req *> reqs;
+
+            for (size_t i = 0; i < host_channel_->count(); ++i)
+                reqs.push_back(&(*host_channel_)[i]);
+
+            std::sort(reqs.begin(), reqs.end(), [](const Night_req *a, const Night_req *b) {
+                return a->from_ < b->from_;
+            });
+
+            for (auto r : reqs) {
+                switch (r->role_) {
+                    case DOC:
+                        target_doc.push_back(r->target_);
+                        break;
+                    case COMA:
+                        if (!r->type_)
+                            target_coma.push_back(r->target_);
+                        else
+                            r->ans_ = role_for_num_[r->target_] == MAFIA ? 1 : 0;
+                        break;
+                    case MANA:
+                        target_mana.push_back(r->target_);
+                        break;
+                }
             }
+        }
 
-            if (host_data_->is_live_[num_coma_]) {
-                host_coma_to_host_->bar_q_c_->arrive_and_wait();
-
-                if (!host_coma_to_host_->type_q_) {
-                    target_coma = host_coma_to_host_->q_;
-                } else {
-                    host_coma_to_host_->ans_ = 
-                        role_for_num_[host_coma_to_host_->q_] == MAFIA ? 1 : 0;
-                }
+        //mafia
+        {
+            Trace_scope ts{"mafia"};
+            host_mafia_privat_->mafia_choice();
 
-                host_coma_to_host_->bar_a_h_->arrive_and_wait();
-            }
+            target_mafia = host_mafia_privat_->tar_;
+        }
 
-            //mafia
-            {
-                host_mafia_privat_->bar_maf_host_->arrive_and_wait();
-                host_mafia_privat_->mafia_choice();
+        std::set<int> safe(target_doc.begin(), target_doc.end());
+        std::vector<std::pair<int, int>> kills; // killer, victim
 
-                target_mafia = host_mafia_privat_->tar_;
-            }
+        for (auto i : target_mana)
+            kills.push_back({MANA, i});
+        if (target_mafia != -1)
+            kills.push_back({MAFIA, target_mafia});
+        for (auto i : target_coma)
+            kills.push_back({COMA, i});
 
-            if (host_data_->is_live_[num_doc_]) {
-                host_doc_to_host_->bar_q_c_->arrive_and_wait();
-                target_doc = host_doc_to_host_->q_; 
-                host_doc_to_host_->bar_a_h_->arrive_and_wait();
-            }
+        std::unique_lock<std::mutex> uls{*host_data_->mut_state_};
 
-            std::unique_lock<std::mutex> uls{*host_data_->mut_state_};
+        for (auto i : safe) {
+            bool saved = false;
 
-            if (target_mana != -1) {
-                host_data_->is_live_[target_mana] = 0;
-                now_live_.erase(target_mana);
+            for (auto &k : kills) {
+                if (k.second == i) {
+                    ++rec_.saved_[k.first];
+                    saved = true;
+                }
             }
 
-            if (target_mafia != -1) {
-                host_data_->is_live_[target_mafia] = 0;
-                now_live_.erase(target_mafia);
-            }
+            rec_.saves_ += saved;
+            if (saved)
+                feed_event(rec_.seed_, day_ - 1, FEED_SAVE, -1, i);
+        }
 
-            if (target_coma != -1) {
-                host_data_->is_live_[target_coma] = 0;
-                now_live_.erase(target_coma);
-            }
+        for (auto &k : kills) {
+            if (!safe.count(k.second) && host_data_->susp_ && host_data_->is_live_[k.second])
+                host_data_->susp_->victim(k.second);
+            if (!safe.count(k.second))
+                rec_kill(k.first, k.second);
+            host_data_->is_live_[k.second] = 0;
+            now_live_.erase(k.second);
+        }
 
-            if (target_doc != -1) {
-                host_data_->is_live_[target_doc] = 1;
-                now_live_.insert(target_doc);
-            }
+        for (auto i : safe) {
+            host_data_->is_live_[i] = 1;
+            now_live_.insert(i);
+        }
 
-            host_data_->bar_res_n_->arrive_and_wait();
+        uls.unlock();
 
-            uls.unlock();
+        if (host_data_->susp_)
+            host_data_->susp_->update(host_data_->is_live_);
 
+        if (print_) {
             std::osyncstream(std::cout) << "Night result" << "\n";
             std::cout.flush();
 
             if (op_cl_info_) {
-                if (target_mana != -1) {
-                    std::osyncstream(std::cout) << "Mana kill " << target_mana << "\n";
-                }
-
-                if (target_mafia != -1) {
-                    std::osyncstream(std::cout) << "Mafia kill " << target_mafia << "\n";
-                }
-
-                if (target_coma != -1) {
-                    std::osyncstream(std::cout) << "Coma kill " << target_coma << "\n";
+                for (auto &k : kills) {
+                    std::osyncstream(std::cout) << (k.first == MANA ? "Mana" : 
+                        k.first == MAFIA ? "Mafia" : "Coma") << " kill " << k.second << "\n";
                 }
 
-                if (target_doc != -1) {
-                    std::osyncstream(std::cout) << "Doc save " << target_doc << "\n";
+                for (auto i : target_doc) {
+                    std::osyncstream(std::cout) << "Doc save " << i << "\n";
                 }
             } else {
-                std::set<int> kill_today{
-                    target_mana, 
-                    target_mafia,
-                    target_coma
-                };
+                std::set<int> kill_today;
 
-                kill_today.erase(target_doc);
+                for (auto &k : kills)
+                    if (!safe.count(k.second))
+                        kill_today.insert(k.second);
 
                 if (kill_today.empty())
                     std::osyncstream(std::cout) << "No kill today\n";
@@ -423,38 +792,37 @@ public:
                     std::osyncstream(std::cout) << "Today kill\n";
 
                     for (auto i : kill_today)
-                        if (i != -1)
-                            std::osyncstream(std::cout) << i << " ";
+                        std::osyncstream(std::cout) << i << " ";
                     std::osyncstream(std::cout) << "\n";
                 }
             }
+        }
 
-            int state_res = state_game(); //0 - go, 1 - civ, 2 - maf, 3 - man
+        int state_res = state_game(); //0 - go, 1 - civ, 2 - maf, 3 - man
+        if (!state_res)
+            state_res = forced(FORCED_VOTE);
 
-            if (state_res) {
-                std::osyncstream(std::cout) << "\n";
-                print_res(state_res);
-                ul.lock();
-                host_data_->theme_ = 2;
-                ul.unlock();
-                return;
-            }
+        if (state_res && print_)
+            std::osyncstream(std::cout) << "\n";
 
-            std::osyncstream(std::cout) << "Now live\n";
-            for (auto i : now_live_) 
-                std::osyncstream(std::cout) << i << " ";
-            std::osyncstream(std::cout) << "\n\n";
+        return rec_end(state_res);
+    }
 
+    void day_begin(void) {
+        print_live();
+        phase_rng(2 * (day_ - 2) + 1);
+
+        if (print_) {
             std::osyncstream(std::cout) << "Day vote\n";
 
             std::cout.flush();
+        }
+    }
 
-            ul.lock();
-            host_data_->theme_ = 0;
-            ul.unlock();
-
-            host_data_->bar_vote_->arrive_and_wait();
-
+    // all votes are in
+    int day_res(void) {
+        Trace_scope ts{"day_res", day_ - 1};
+        if (print_) {
             std::osyncstream(std::cout) << "Vote result\n";
 
             for (auto i : now_live_) 
@@ -464,19 +832,60 @@ public:
             for (auto i : now_live_) 
                 std::osyncstream(std::cout) << host_data_->vote_list_[i] << " ";
             std::osyncstream(std::cout) << "\n";
+        }
 
-            vote_res();
+        vote_res();
 
-            std::osyncstream(std::cout) << "Now live\n";
-            for (auto i : now_live_) 
-                std::osyncstream(std::cout) << i << " ";
-            std::osyncstream(std::cout) << "\n\n";
+        if (host_data_->susp_)
+            host_data_->susp_->vote(host_data_->vote_list_);
 
+        print_live();
+
+        if (print_)
             std::cout.flush();
 
-            host_data_->bar_res_d_->arrive_and_wait();
+        int state_res = state_game(); //0 - go, 1 - civ, 2 - maf, 3 - man
+        if (!state_res)
+            state_res = forced(FORCED_NIGHT);
+
+        if (state_res)
+            return rec_end(state_res);
+
+        //clear all
+        host_data_->last_vote_ = host_data_->vote_list_;
+
+        for (int i = 0; i < host_data_->N_; ++i) 
+            host_data_->vote_list_[i] = -1;
+
+        host_mafia_privat_->clear();
+        host_channel_->clear();
+
+        return 0;
+    }
+
+    void host_loop(void) {
+        tracer().name_thread("host");
+
+        while (true) {
+            int state_res = 0;
+            std::unique_lock<std::mutex> ul{*host_data_->mut_theme_, std::defer_lock};
+
+            {
+                Trace_scope ts{"night", day_};
+                night_begin();
+
+                ul.lock();
+                host_data_->theme_ = 1;
+                ul.unlock();
+
+                //all roles act at once, the host only gathers the requests
+                traced_wait(*host_data_->bar_act_n_, host_data_->N_, "bar_act_n_");
+
+                state_res = night_res();
+                cmd_io().resolved();
 
-            state_res = state_game(); //0 - go, 1 - civ, 2 - maf, 3 - man
+                traced_wait(*host_data_->bar_res_n_, host_data_->N_, "bar_res_n_");
+            }
 
             if (state_res) {
                 print_res(state_res);
@@ -486,39 +895,142 @@ public:
                 return;
             }
 
-            //clear all
-            
-            for (int i = 0; i < host_data_->N_; ++i) 
-                host_data_->vote_list_[i] = -1;
+            {
+                Trace_scope ts{"vote", day_ - 1};
+                day_begin();
 
-            host_mafia_privat_->target_.clear();
-            host_mafia_privat_->s_target_.clear();
-            host_mafia_privat_->tar_ = -1;
-        }
-    }
+                ul.lock();
+                host_data_->theme_ = 0;
+                ul.unlock();
 
-};
+                traced_wait(*host_data_->bar_vote_, host_data_->N_, "bar_vote_");
 
-class Player
-{
-public:
-    int num_;
-    Shared_ptr<Data> data_;
+                state_res = day_res();
+                cmd_io().resolved();
 
-    Player () = default;
+                traced_wait(*host_data_->bar_res_d_, host_data_->N_, "bar_res_d_");
+            }
 
-    Player (const int &num, Shared_ptr<Data> &data) :
+            if (state_res) {
+                print_res(state_res);
+                ul.lock();
+                host_data_->theme_ = 2;
+                ul.unlock();
+                return;
+            }
+        }
+    }
+
+};
+
+class Player
+{
+public:
+    int num_;
+    Shared_ptr<Data> data_;
+    Rng rng_;
+    uint64_t seed_{0};
+    int phase_{0};
+
+    Player () = default;
+
+    Player (const int &num, Shared_ptr<Data> &data) :
         num_(num),
         data_(data)
     {}
 
+    void seed(const uint64_t &seed) {
+        seed_ = seed;
+        rng_ = Rng(seed, num_);
+    }
+
+    // phase - 2 (day - 1) for the night, one more for the vote, the
+    // first night is 0 for the threaded players, the host and the pool
+    // driven Game alike. With crn_ a choice that takes more draws than in
+    // the other arm of a paired run leaves the draws of the later phases
+    // the same.
+    void phase_rng(const int &phase) {
+        phase_ = phase;
+        if (data_->crn_)
+            rng_ = Rng::phase(seed_, phase, num_);
+    }
+
+    int live_count(void) const {
+        int n = 0;
+        for (int i = 0; i < data_->N_; ++i)
+            n += data_->is_live_[i];
+        return n;
+    }
+
+    // a random live seat that isn't this one nor in skip, -1 if there is none
+    template<class Skip>
+    int random_other(const Skip &skip) {
+        std::vector<int> c;
+        for (int i = 0; i < data_->N_; ++i)
+            if (data_->is_live_[i] && i != num_ && !skip(i))
+                c.push_back(i);
+
+        return c.empty() ? -1 : c[rng_.randint(0, int(c.size() - 1))];
+    }
+
+    // An action of pol in row info of the table, out of the legal ones by
+    // bit. The learning seat of a Cfr game explores and keeps what it did.
+    int policy_pick(const Policy &pol, const int &info, const unsigned &legal) {
+        Policy_learn *learn = data_->learn_.get();
+        bool learning = learn && learn->seat_ == num_;
+        const float *p = pol.at(info);
+        double q[Policy::acts_];
+        double sum = 0, ps = 0;
+
+        for (int a = 0; a < Policy::acts_; ++a)
+            ps += (legal >> a & 1) * p[a];
+
+        for (int a = 0; a < Policy::acts_; ++a) {
+            double pa = ps > 0 ? p[a] / ps : 1.0 / __builtin_popcount(legal);
+            q[a] = !(legal >> a & 1) ? 0 :
+                learning ? pol.eps_ / __builtin_popcount(legal) + (1 - pol.eps_) * pa : pa;
+            sum += q[a];
+        }
+
+        double x = rng_.uniform() * sum;
+        int act = 0;
+        for (; act + 1 < Policy::acts_; ++act) {
+            if (x < q[act])
+                break;
+            x -= q[act];
+        }
+        if (!q[act])   // rounding at the end
+            act = 31 - __builtin_clz(legal);
+
+        if (learning)
+            learn->steps_.push_back({info, act, uint8_t(legal), float(q[act] / sum)});
+
+        return act;
+    }
+
+    // the day vote of a STRAT_POLICY bot, special - the seat of the third
+    // action, -1 if it has none
+    void policy_vote(const Policy &pol, const int &role, const int &priv, const int &special) {
+        int info = Policy::info(role, POL_VOTE, phase_ / 2, live_count(), priv);
+        int act = policy_pick(pol, info, special == -1 ? 3 : 7);
+
+        if (act == 2) {
+            std::lock_guard<std::mutex> lg{*data_->mut_vote_};
+            data_->vote_list_[num_] = special;
+            return;
+        }
+
+        if (act == 0 || !herd_vote(1))
+            Player::vote();
+    }
+
     virtual void act(void) {
     }
     virtual void vote(void) {
         int target = -1;
 
         while (true) {
-            target = std::experimental::randint(0, int(data_->N_-1));
+            target = rng_.randint(0, int(data_->N_-1));
             
             if (data_->is_live_[target] && target != num_)
                 break;
@@ -528,10 +1040,49 @@ public:
         data_->vote_list_[num_] = target;
     } 
 
+    // votes with the most voted live seat so far with chance p, false if
+    // it didn't
+    bool herd_vote(const double &p) {
+        if (rng_.uniform() >= p)
+            return false;
+
+        std::lock_guard<std::mutex> lg{*data_->mut_vote_};
+        std::vector<int> count(data_->N_, 0);
+        int target = -1;
+
+        for (auto i : data_->vote_list_)
+            if (i != -1 && i != num_ && data_->is_live_[i] && ++count[i] > (target == -1 ? 0 : count[target]))
+                target = i;
+
+        if (target == -1)
+            return false;
+
+        data_->vote_list_[num_] = target;
+        return true;
+    }
+
+    // called once when the player leaves the game, drop out of role barriers here
     virtual void act_after_die(void) {}
 
+    // the dead don't take part in the barriers of the next phases
+    void retire(void) {
+        data_->bar_vote_->arrive_and_drop(num_);
+        data_->bar_res_d_->arrive_and_drop(num_);
+        data_->bar_act_n_->arrive_and_drop(num_);
+        data_->bar_res_n_->arrive_and_drop(num_);
+
+        act_after_die();
+    }
+
+    // called after the night result, when the host answers are ready
+    virtual void act_res(void) {}
+
     void game_loop(void) {
+        if (tracer().on())
+            tracer().name_thread("player " + std::to_string(num_));
+
         int self_theme = -1; //0 - day, 1 - night, 2 - end 
+        int phase = 0;
         while (true) {
             std::unique_lock<std::mutex> uls{*data_->mut_state_};
             if (!data_->is_live_[num_])
@@ -546,10 +1097,14 @@ public:
                 if (self_theme == 0)
                     std::this_thread::yield();
                 else {
-                    vote();
-                    auto ar_out = data_->bar_vote_->arrive();
-
-                    data_->bar_res_d_->arrive_and_wait();
+                    {
+                        Trace_scope ts{"vote", num_};
+                        phase_rng(phase++);
+                        vote();
+                    }
+                    data_->bar_vote_->arrive(num_);
+
+                    traced_wait(*data_->bar_res_d_, num_, "bar_res_d_");
                 }
 
                 self_theme = 0;
@@ -559,9 +1114,15 @@ public:
                 if (self_theme == 1)
                     std::this_thread::yield();
                 else {
-                    act();
-
-                    data_->bar_res_n_->arrive_and_wait();
+                    {
+                        Trace_scope ts{"act", num_};
+                        phase_rng(phase++);
+                        act();
+                    }
+                    data_->bar_act_n_->arrive(num_);
+
+                    traced_wait(*data_->bar_res_n_, num_, "bar_res_n_");
+                    act_res();
                 }
 
                 self_theme = 1;
@@ -570,32 +1131,7 @@ public:
                 return;
         }
 
-        while (true) {
-            std::unique_lock<std::mutex> ul{*data_->mut_theme_};
-
-            if (data_->theme_ == 0) {
-                ul.unlock();
-                if (self_theme == 0)
-                    std::this_thread::yield();
-                else {
-                    auto ar_out = data_->bar_vote_->arrive();
-                    data_->bar_res_d_->arrive_and_wait();
-                }
-
-                self_theme = 0;
-            } else if (data_->theme_ == 1) {
-                ul.unlock();
-                if (self_theme == 1)
-                    std::this_thread::yield();
-                else {
-                    act_after_die();
-                    data_->bar_res_n_->arrive_and_wait();
-                }
-
-                self_theme = 1;
-            } else if (data_->theme_ == 2)
-                return;
-        }
+        retire();
     }
 
     virtual ~Player() = default;
@@ -605,17 +1141,20 @@ void vote_cmd(Shared_ptr<Data> &data_, const int &num_) {
     int target = -1;
     std::osyncstream(std::cout) << "Your choice:\n";
     std::cout.flush();
+    cmd_io().prompt(num_, CMD_VOTE);
 
     while (true) {
-        std::cin >> target; 
+        target = cmd_io().seat(num_);
         
-        if (data_->is_live_[target] && target != num_)
+        if (target >= 0 && target < data_->N_ && data_->is_live_[target] && target != num_)
             break;
         else 
             std::osyncstream(std::cout) << "Wrong number, try again\n";
         std::cout.flush();
     }
 
+    cmd_io().answered(num_);
+
     std::lock_guard<std::mutex> lg{*data_->mut_vote_};
     data_->vote_list_[num_] = target;
 }
@@ -643,26 +1182,51 @@ public:
     }
 };
 
+// Votes the most suspect live seat, a random one of them on a tie
+class Civilian_suspect : public Civilian
+{
+public:
+    Civilian_suspect (const int &num, Shared_ptr<Data> &data) {
+        num_ = num;
+        data_ = data;
+    }
+
+    void vote(void) override {
+        const std::vector<int> &top = data_->susp_->top();
+        int target = -1;
+
+        if (top.empty() || (top.size() == 1 && top[0] == num_))
+            return Player::vote();
+
+        do {
+            target = top[rng_.randint(0, int(top.size() - 1))];
+        } while (target == num_);
+
+        std::lock_guard<std::mutex> lg{*data_->mut_vote_};
+        data_->vote_list_[num_] = target;
+    }
+};
+
 class Doc : public Player
 {
 public:
     int prev_safe_;
-    Shared_ptr<Doc_to_host> doc_to_host_;
+    Shared_ptr<Host_channel> to_host_;
 
     Doc () = default;
 
-    Doc (const int &num, Shared_ptr<Data> &data, Shared_ptr<Doc_to_host> &doc_to_host) {
+    Doc (const int &num, Shared_ptr<Data> &data, Shared_ptr<Host_channel> &to_host) {
         num_ = num;
         data_ = data;
         prev_safe_ = -1;
-        doc_to_host_ = doc_to_host;
+        to_host_ = to_host;
     }
 
     void act(void) override {
         int target = -1;
 
         while (true) {
-            target = std::experimental::randint(0, int(data_->N_-1));
+            target = rng_.randint(0, int(data_->N_-1));
             
             if (data_->is_live_[target] && prev_safe_ != target) {
                 prev_safe_ = target;
@@ -670,32 +1234,30 @@ public:
             }
         }
 
-        doc_to_host_->q_ = target;
-
-        doc_to_host_->bar_q_c_->arrive_and_wait();
-        doc_to_host_->bar_a_h_->arrive_and_wait();
+        to_host_->submit({num_, DOC, 0, target, 0});
     }
 };
 
 class Doc_cmd : public Doc
 {
 public:
-    Doc_cmd (const int &num, Shared_ptr<Data> &data, Shared_ptr<Doc_to_host> &doc_to_host) {
+    Doc_cmd (const int &num, Shared_ptr<Data> &data, Shared_ptr<Host_channel> &to_host) {
         num_ = num;
         data_ = data;
         prev_safe_ = -1;
-        doc_to_host_ = doc_to_host;
+        to_host_ = to_host;
     }
 
     void act(void) override {
         int target = -1;
         std::osyncstream(std::cout) << "Your choice:\n";
         std::cout.flush();
+        cmd_io().prompt(num_, CMD_NIGHT);
 
         while (true) {
-            std::cin >> target; 
+            target = cmd_io().seat(num_);
             
-            if (data_->is_live_[target] && target != prev_safe_) {
+            if (target >= 0 && target < data_->N_ && data_->is_live_[target] && target != prev_safe_) {
                 prev_safe_ = target;
                 break;
             }
@@ -703,10 +1265,8 @@ public:
                 std::osyncstream(std::cout) << "Wrong number, try again\n";
             std::cout.flush();
         }
-        doc_to_host_->q_ = target;
-
-        doc_to_host_->bar_q_c_->arrive_and_wait();
-        doc_to_host_->bar_a_h_->arrive_and_wait();
+        cmd_io().answered(num_);
+        to_host_->submit({num_, DOC, 0, target, 0});
     }
 
     void vote(void) override {
@@ -714,96 +1274,180 @@ public:
     }
 };
 
+class Doc_self : public Doc
+{
+public:
+    Doc_self (const int &num, Shared_ptr<Data> &data, Shared_ptr<Host_channel> &to_host) {
+        num_ = num;
+        data_ = data;
+        prev_safe_ = -1;
+        to_host_ = to_host;
+    }
+
+    void act(void) override {
+        if (prev_safe_ == num_)
+            return Doc::act();
+
+        prev_safe_ = num_;
+        to_host_->submit({num_, DOC, 0, num_, 0});
+    }
+};
+
 class Coma : public Player
 {
 public:
-    std::queue<int> q_;
-    std::set<int> s_;
-    Shared_ptr<Coma_to_host> coma_to_host_;
+    std::vector<int> q_;   // mafia found, the first not yet killed at q_head_
+    size_t q_head_{0};
+    Seat_bits s_;          // checked
+    int check_{-1};
+    size_t slot_{0}; // of the check in to_host_
+    Shared_ptr<Host_channel> to_host_;
 
     Coma () = default;
 
-    Coma (const int &num, Shared_ptr<Data> &data, Shared_ptr<Coma_to_host> &coma_to_host) {
+    Coma (const int &num, Shared_ptr<Data> &data, Shared_ptr<Host_channel> &to_host) {
         num_ = num;
         data_ = data;
-        coma_to_host_ = coma_to_host;
+        to_host_ = to_host;
     }
 
+    // drops the dead from q_
     void state(void) {
-        std::queue<int> new_q;
+        size_t n = 0;
 
-        while (!q_.empty()) {
-            int vr = q_.front();
-            q_.pop();
+        for (size_t i = q_head_; i < q_.size(); ++i)
+            if (data_->is_live_[q_[i]])
+                q_[n++] = q_[i];
 
-            if (data_->is_live_[vr])
-                new_q.push(vr);
-        }
+        q_.resize(n);
+        q_head_ = 0;
+    }
+
+    bool q_empty(void) const {
+        return q_head_ == q_.size();
+    }
+
+    int q_front(void) const {
+        return q_[q_head_];
+    }
 
-        q_ = std::move(new_q);
+    void q_pop(void) {
+        ++q_head_;
     }
 
     void vote(void) override {
         state();
         int target = -1;
 
-        if (q_.empty()) {
+        if (q_empty()) {
             while (true) {
-                target = std::experimental::randint(0, int(data_->N_-1));
+                target = rng_.randint(0, int(data_->N_-1));
                 
                 if (data_->is_live_[target])
                     break;
             }
         } else {
-            target = q_.front();
+            target = q_front();
         }
 
         std::lock_guard<std::mutex> lg{*data_->mut_vote_};
         data_->vote_list_[num_] = target;
     }
 
+    // is there anyone alive left to check
+    bool can_check(void) {
+        for (int i = 0; i < data_->N_; ++i)
+            if (data_->is_live_[i] && !s_.count(i) && i != num_)
+                return true;
+
+        return false;
+    }
+
     void act(void) override {
         state();
-        int random_number = std::experimental::randint(0, int(1));
+        int random_number = rng_.randint(0, int(1));
         int target = -1;
 
-        if (!random_number % 2) { //rn = 0, kill;  rn = 1 question
-            coma_to_host_->type_q_ = 0;
+        if (!can_check())
+            random_number = 0;
 
-            if (q_.empty()) {
+        if (!random_number % 2) { //rn = 0, kill;  rn = 1 question
+            if (q_empty()) {
                 while (true) {
-                    target = std::experimental::randint(0, int(data_->N_-1));
+                    target = rng_.randint(0, int(data_->N_-1));
                     
                     if (data_->is_live_[target] && target != num_)
                         break;
                 }
             } else {
-                target = q_.front();
-                q_.pop();
+                target = q_front();
+                q_pop();
             }
             
-            coma_to_host_->q_ = target;
-
-            coma_to_host_->bar_q_c_->arrive_and_wait();
-            coma_to_host_->bar_a_h_->arrive_and_wait();
+            to_host_->submit({num_, COMA, 0, target, 0});
         } else {
-            coma_to_host_->type_q_ = 1;
-
             while (true) {
-                target = std::experimental::randint(0, int(data_->N_-1));
+                target = rng_.randint(0, int(data_->N_-1));
                 
                 if (data_->is_live_[target] && !s_.count(target) && target != num_)
                     break;
             }
 
-            coma_to_host_->q_ = target;
+            slot_ = to_host_->submit({num_, COMA, 1, target, 0});
             s_.insert(target);
+            check_ = target;
+        }
+    }
+
+    void act_res(void) override {
+        if (check_ == -1 || slot_ == Host_channel::full_)
+            return;
+
+        if ((*to_host_)[slot_].ans_)
+            q_.push_back(check_);
+
+        check_ = -1;
+    }
+};
+
+class Coma_check : public Coma
+{
+public:
+    Coma_check (const int &num, Shared_ptr<Data> &data, Shared_ptr<Host_channel> &to_host) {
+        num_ = num;
+        data_ = data;
+        to_host_ = to_host;
+    }
+
+    void act(void) override {
+        state();
+        int target = -1;
 
-            coma_to_host_->bar_q_c_->arrive_and_wait();
-            coma_to_host_->bar_a_h_->arrive_and_wait();
+        if (!q_empty() || !can_check()) {
+            if (q_empty()) {
+                while (true) {
+                    target = rng_.randint(0, int(data_->N_-1));
 
-            if (coma_to_host_->ans_)
-                q_.push(target);
+                    if (data_->is_live_[target] && target != num_)
+                        break;
+                }
+            } else {
+                target = q_front();
+                q_pop();
+            }
+
+            to_host_->submit({num_, COMA, 0, target, 0});
+        } else {
+            while (true) {
+                target = rng_.randint(0, int(data_->N_-1));
+
+                if (data_->is_live_[target] && !s_.count(target) && target != num_)
+                    break;
+            }
+
+            slot_ = to_host_->submit({num_, COMA, 1, target, 0});
+            s_.insert(target);
+            check_ = target;
         }
     }
 };
@@ -811,10 +1455,10 @@ public:
 class Coma_cmd : public Coma
 {
 public:
-    Coma_cmd (const int &num, Shared_ptr<Data> &data, Shared_ptr<Coma_to_host> &coma_to_host) {
+    Coma_cmd (const int &num, Shared_ptr<Data> &data, Shared_ptr<Host_channel> &to_host) {
         num_ = num;
         data_ = data;
-        coma_to_host_ = coma_to_host;
+        to_host_ = to_host;
     }
 
     void vote(void) override {
@@ -826,11 +1470,12 @@ public:
         int target = -1;
         std::osyncstream(std::cout) << "Your choice(kill\\n 0 or check\\n 0):\n";
         std::cout.flush();
+        cmd_io().prompt(num_, CMD_NIGHT);
 
         std::string vr = "";
 
         do {
-            std::cin >> vr;
+            vr = cmd_io().word(num_);
 
             if (vr != "kill" and vr != "check") {
                 std::osyncstream(std::cout) << "Wrong input, try again\n";
@@ -841,78 +1486,74 @@ public:
         number = vr == "check";
 
         while (true) {
-            std::cin >> target; 
+            target = cmd_io().seat(num_);
             
-            if (data_->is_live_[target] && target != num_)
+            if (target >= 0 && target < data_->N_ && data_->is_live_[target] && target != num_)
                 break;
             else 
                 std::osyncstream(std::cout) << "Wrong number, try again\n";
             std::cout.flush();
         }
 
-        if (!number % 2) { //rn = 0, kill;  rn = 1 question
-            coma_to_host_->type_q_ = 0;
-            
-            coma_to_host_->q_ = target;
+        cmd_io().answered(num_);
 
-            coma_to_host_->bar_q_c_->arrive_and_wait();
-            coma_to_host_->bar_a_h_->arrive_and_wait();
+        if (!number % 2) { //rn = 0, kill;  rn = 1 question
+            to_host_->submit({num_, COMA, 0, target, 0});
         } else {
-            coma_to_host_->type_q_ = 1;
-
-            coma_to_host_->q_ = target;
-
-            coma_to_host_->bar_q_c_->arrive_and_wait();
-            coma_to_host_->bar_a_h_->arrive_and_wait();
+            slot_ = to_host_->submit({num_, COMA, 1, target, 0});
+            check_ = target;
+        }
+    }
 
-            if (coma_to_host_->ans_) {
-                std::osyncstream(std::cout) << target << " is Mafia\n";
-            } else {
-                std::osyncstream(std::cout) << target << " is Civillian\n";
-            }
+    void act_res(void) override {
+        if (check_ == -1 || slot_ == Host_channel::full_)
+            return;
 
-            std::cout.flush();
+        if ((*to_host_)[slot_].ans_) {
+            std::osyncstream(std::cout) << check_ << " is Mafia\n";
+        } else {
+            std::osyncstream(std::cout) << check_ << " is Civillian\n";
         }
+
+        std::cout.flush();
+        check_ = -1;
     }
 };
 
 class Mana : public Player
 {
 public:
-    Shared_ptr<Mana_to_host> mana_to_host_;
+    Shared_ptr<Host_channel> to_host_;
 
     Mana () = default;
 
-    Mana (const int &num, Shared_ptr<Data> &data, Shared_ptr<Mana_to_host> &mana_to_host) {
+    Mana (const int &num, Shared_ptr<Data> &data, Shared_ptr<Host_channel> &to_host) {
         num_ = num;
         data_ = data;
-        mana_to_host_ = mana_to_host;
+        to_host_ = to_host;
     }
 
     void act(void) override {
         int target = -1;
 
         while (true) {
-            target = std::experimental::randint(0, int(data_->N_-1));
+            target = rng_.randint(0, int(data_->N_-1));
 
             if (data_->is_live_[target] && target != num_)
                 break;
         }
 
-        mana_to_host_->q_ = target;
-
-        mana_to_host_->bar_q_c_->arrive_and_wait();
-        mana_to_host_->bar_a_h_->arrive_and_wait();
+        to_host_->submit({num_, MANA, 0, target, 0});
     } 
 };
 
 class Mana_cmd : public Mana 
 {
 public:
-    Mana_cmd (const int &num, Shared_ptr<Data> &data, Shared_ptr<Mana_to_host> &mana_to_host) {
+    Mana_cmd (const int &num, Shared_ptr<Data> &data, Shared_ptr<Host_channel> &to_host) {
         num_ = num;
         data_ = data;
-        mana_to_host_ = mana_to_host;
+        to_host_ = to_host;
     }
 
     void vote(void) override {
@@ -923,21 +1564,20 @@ public:
         int target = -1;
         std::osyncstream(std::cout) << "Your choice:\n";
         std::cout.flush();
+        cmd_io().prompt(num_, CMD_NIGHT);
 
         while (true) {
-            std::cin >> target; 
+            target = cmd_io().seat(num_);
             
-            if (data_->is_live_[target] && target != num_)
+            if (target >= 0 && target < data_->N_ && data_->is_live_[target] && target != num_)
                 break;
             else 
                 std::osyncstream(std::cout) << "Wrong number, try again\n";
             std::cout.flush();
         }
 
-        mana_to_host_->q_ = target;
-
-        mana_to_host_->bar_q_c_->arrive_and_wait();
-        mana_to_host_->bar_a_h_->arrive_and_wait();
+        cmd_io().answered(num_);
+        to_host_->submit({num_, MANA, 0, target, 0});
     } 
 };
 
@@ -945,54 +1585,75 @@ class Mafia : public Player
 {
 public:
     Shared_ptr<Mafia_privat> maf_priv_;
-    std::set<int> maf_bro_;
 
     Mafia () = default;
 
-    Mafia (const int &num, Shared_ptr<Data> &data, Shared_ptr<Mafia_privat> & maf_priv, std::set<int> &maf_bro) {
+    Mafia (const int &num, Shared_ptr<Data> &data, Shared_ptr<Mafia_privat> & maf_priv) {
         num_ = num;
         data_ = data;
         maf_priv_ = maf_priv;
-        maf_bro_.insert(maf_bro.begin(), maf_bro.end());
     }
 
     void act(void) override {
         int target = -1;
 
         while (true) {
-            target = std::experimental::randint(0, int(data_->N_-1));
+            target = rng_.randint(0, int(data_->N_-1));
             
-            if (data_->is_live_[target] && !maf_bro_.count(target))
+            if (data_->is_live_[target] && !maf_priv_->roster_.count(target))
                 break;
         }
 
-        std::unique_lock<std::mutex> ul{*maf_priv_->mut_tar_};
-        maf_priv_->s_target_.insert(target);
-        maf_priv_->target_.insert(target);
-        ul.unlock();
-
-        maf_priv_->bar_maf_vote_->arrive_and_wait();
+        maf_priv_->vote(num_, target);
 
-        maf_priv_->mafia_choice();
-        
-        maf_priv_->bar_maf_host_->arrive_and_wait();
+        //only Mafia_cmd waits for the bros, the host counts the votes
+        maf_priv_->bar_maf_vote_->arrive(num_);
     }
 
     void act_after_die(void) override {
-        maf_priv_->bar_maf_vote_->arrive_and_wait();
-        maf_priv_->mafia_choice();
-        maf_priv_->bar_maf_host_->arrive_and_wait();
+        maf_priv_->bar_maf_vote_->arrive_and_drop(num_);
+    }
+};
+
+class Mafia_focus : public Mafia
+{
+public:
+    Mafia_focus () = default;
+
+    Mafia_focus (const int &num, Shared_ptr<Data> &data, Shared_ptr<Mafia_privat> & maf_priv) {
+        num_ = num;
+        data_ = data;
+        maf_priv_ = maf_priv;
+    }
+
+    // the most voted live target so far, or a random one if there is none
+    void act(void) override {
+        int target = -1;
+        int count = 0;
+
+        for (auto i : maf_priv_->votes()) {
+            if (i.second > count && data_->is_live_[i.first]) {
+                count = i.second;
+                target = i.first;
+            }
+        }
+
+        if (target == -1)
+            return Mafia::act();
+
+        maf_priv_->vote(num_, target);
+
+        maf_priv_->bar_maf_vote_->arrive(num_);
     }
 };
 
 class Mafia_cmd : public Mafia 
 {
 public:
-    Mafia_cmd (const int &num, Shared_ptr<Data> &data, Shared_ptr<Mafia_privat> & maf_priv, std::set<int> &maf_bro) {
+    Mafia_cmd (const int &num, Shared_ptr<Data> &data, Shared_ptr<Mafia_privat> & maf_priv) {
         num_ = num;
         data_ = data;
         maf_priv_ = maf_priv;
-        maf_bro_.insert(maf_bro.begin(), maf_bro.end());
     }
 
     void vote(void) override {
@@ -1002,34 +1663,373 @@ public:
     void act(void) override {
         int target = -1;
 
-        maf_priv_->bar_maf_vote_->arrive_and_wait();
+        traced_wait(*maf_priv_->bar_maf_vote_, num_, "bar_maf_vote_");
 
-        std::unique_lock<std::mutex> ul{*maf_priv_->mut_tar_};
+        //the bros have voted, what they sent is all there is, no lock needed
         std::osyncstream(std::cout) << "Maf bro choice:\n";
 
-        for (auto i : maf_priv_->s_target_) {
-            std::osyncstream(std::cout) << i << ": " << maf_priv_->target_.count(i) << "Maf bro\n";
+        for (auto i : maf_priv_->votes()) {
+            std::osyncstream(std::cout) << i.first << ": " << i.second << " Maf bro\n";
         }
-        std::osyncstream(std::cout) << "Your choice:\n";
+
+        // what the other human bros say while this one answers, shown
+        // on every pass
+        size_t shown = 0;
+        auto show_chat = [&] {
+            for (auto &i : maf_priv_->chat_->since(shown))
+                if (i.from_ != num_)
+                    std::osyncstream(std::cout) << "Maf bro " << i.from_ << ":" << i.text_ << "\n";
+            std::cout.flush();
+        };
+
+        show_chat();
+        std::osyncstream(std::cout) << "Your choice(or say text):\n";
         std::cout.flush();
+        cmd_io().prompt(num_, CMD_NIGHT);
 
         while (true) {
-            std::cin >> target; 
+            std::string vr = cmd_io().word(num_);
+
+            show_chat();
+
+            if (vr == "say") {
+                Maf_msg msg{num_, ""};
+                std::string text = cmd_io().in(num_).rest();
+
+                text.copy(msg.text_, sizeof(msg.text_) - 1);
+                if (!maf_priv_->chat_->push(msg))
+                    std::osyncstream(std::cout) << "The chat is full tonight, vote\n";
+                continue;
+            }
+
+            target = std::atoi(vr.c_str());
             
-            if (data_->is_live_[target] && !maf_bro_.count(target))
+            if (target >= 0 && target < data_->N_ && data_->is_live_[target] && !maf_priv_->roster_.count(target))
                 break;
             else 
                 std::osyncstream(std::cout) << "Wrong number, try again\n";
             std::cout.flush();
         }
-        maf_priv_->s_target_.insert(target);
-        maf_priv_->target_.insert(target);
-        maf_priv_->tar_ = -1;
-        ul.unlock();
 
-        maf_priv_->mafia_choice();
-        
-        maf_priv_->bar_maf_host_->arrive_and_wait();
+        cmd_io().answered(num_);
+        maf_priv_->vote(num_, target);
+    }
+};
+
+// STRAT_TUNED bots, the base ones with the chances of Bot_params
+
+class Civilian_tuned : public Civilian
+{
+public:
+    Bot_params params_;
+
+    Civilian_tuned (const int &num, Shared_ptr<Data> &data, const Bot_params &params) {
+        num_ = num;
+        data_ = data;
+        params_ = params;
+    }
+
+    void vote(void) override {
+        if (!herd_vote(params_[Bot_params::HERD]))
+            Player::vote();
+    }
+};
+
+class Doc_tuned : public Doc
+{
+public:
+    Bot_params params_;
+
+    Doc_tuned (const int &num, Shared_ptr<Data> &data, Shared_ptr<Host_channel> &to_host, const Bot_params &params) {
+        num_ = num;
+        data_ = data;
+        prev_safe_ = -1;
+        to_host_ = to_host;
+        params_ = params;
+    }
+
+    void act(void) override {
+        if (prev_safe_ == num_ || rng_.uniform() >= params_[Bot_params::DOC_SELF])
+            return Doc::act();
+
+        prev_safe_ = num_;
+        to_host_->submit({num_, DOC, 0, num_, 0});
+    }
+
+    void vote(void) override {
+        if (!herd_vote(params_[Bot_params::HERD]))
+            Player::vote();
+    }
+};
+
+class Coma_tuned : public Coma
+{
+public:
+    Bot_params params_;
+
+    Coma_tuned (const int &num, Shared_ptr<Data> &data, Shared_ptr<Host_channel> &to_host, const Bot_params &params) {
+        num_ = num;
+        data_ = data;
+        to_host_ = to_host;
+        params_ = params;
+    }
+
+    void vote(void) override {
+        state();
+
+        if (!q_empty() && rng_.uniform() < params_[Bot_params::COMA_FOLLOW]) {
+            std::lock_guard<std::mutex> lg{*data_->mut_vote_};
+            data_->vote_list_[num_] = q_front();
+            return;
+        }
+
+        if (!herd_vote(params_[Bot_params::HERD]))
+            Player::vote();
+    }
+
+    void act(void) override {
+        state();
+        int target = -1;
+
+        if (!can_check() || rng_.uniform() >= params_[Bot_params::COMA_CHECK]) {
+            if (q_empty()) {
+                while (true) {
+                    target = rng_.randint(0, int(data_->N_-1));
+
+                    if (data_->is_live_[target] && target != num_)
+                        break;
+                }
+            } else {
+                target = q_front();
+                q_pop();
+            }
+
+            to_host_->submit({num_, COMA, 0, target, 0});
+        } else {
+            while (true) {
+                target = rng_.randint(0, int(data_->N_-1));
+
+                if (data_->is_live_[target] && !s_.count(target) && target != num_)
+                    break;
+            }
+
+            slot_ = to_host_->submit({num_, COMA, 1, target, 0});
+            s_.insert(target);
+            check_ = target;
+        }
+    }
+};
+
+class Mafia_tuned : public Mafia_focus
+{
+public:
+    Bot_params params_;
+
+    Mafia_tuned (const int &num, Shared_ptr<Data> &data, Shared_ptr<Mafia_privat> & maf_priv, const Bot_params &params) {
+        num_ = num;
+        data_ = data;
+        maf_priv_ = maf_priv;
+        params_ = params;
+    }
+
+    void act(void) override {
+        if (rng_.uniform() < params_[Bot_params::MAFIA_FOCUS])
+            Mafia_focus::act();
+        else
+            Mafia::act();
+    }
+
+    void vote(void) override {
+        if (!herd_vote(params_[Bot_params::HERD]))
+            Player::vote();
+    }
+};
+
+// STRAT_POLICY bots, the kinds of target of a Policy. With no table all
+// the allowed kinds are as likely.
+
+const Policy &policy_or_uniform(const std::shared_ptr<const Policy> &pol) {
+    static const Policy uniform;
+    return pol ? *pol : uniform;
+}
+
+class Civilian_policy : public Civilian
+{
+public:
+    std::shared_ptr<const Policy> policy_;
+
+    Civilian_policy (const int &num, Shared_ptr<Data> &data, const std::shared_ptr<const Policy> &policy) {
+        num_ = num;
+        data_ = data;
+        policy_ = policy;
+    }
+
+    void vote(void) override {
+        policy_vote(policy_or_uniform(policy_), CIVILIAN, 0, -1);
     }
 };
 
+class Doc_policy : public Doc
+{
+public:
+    std::shared_ptr<const Policy> policy_;
+
+    Doc_policy (const int &num, Shared_ptr<Data> &data, Shared_ptr<Host_channel> &to_host,
+        const std::shared_ptr<const Policy> &policy)
+    {
+        num_ = num;
+        data_ = data;
+        prev_safe_ = -1;
+        to_host_ = to_host;
+        policy_ = policy;
+    }
+
+    void act(void) override {
+        int self = prev_safe_ == num_;
+        int info = Policy::info(DOC, POL_NIGHT, phase_ / 2, live_count(), self);
+
+        if (policy_pick(policy_or_uniform(policy_), info, self ? 1 : 3) == 0)
+            return Doc::act();
+
+        prev_safe_ = num_;
+        to_host_->submit({num_, DOC, 0, num_, 0});
+    }
+
+    void vote(void) override {
+        policy_vote(policy_or_uniform(policy_), DOC, 0, -1);
+    }
+};
+
+class Coma_policy : public Coma
+{
+public:
+    std::shared_ptr<const Policy> policy_;
+
+    Coma_policy (const int &num, Shared_ptr<Data> &data, Shared_ptr<Host_channel> &to_host,
+        const std::shared_ptr<const Policy> &policy)
+    {
+        num_ = num;
+        data_ = data;
+        to_host_ = to_host;
+        policy_ = policy;
+    }
+
+    void vote(void) override {
+        state();
+        policy_vote(policy_or_uniform(policy_), COMA, !q_empty(), q_empty() ? -1 : q_front());
+    }
+
+    void act(void) override {
+        state();
+        bool check = can_check();
+        int info = Policy::info(COMA, POL_NIGHT, phase_ / 2, live_count(), int(!q_empty()) | check << 1);
+        int target = -1;
+
+        if (policy_pick(policy_or_uniform(policy_), info, check ? 3 : 1) == 0) {
+            if (q_empty()) {
+                target = random_other([](int) { return false; });
+            } else {
+                target = q_front();
+                q_pop();
+            }
+
+            to_host_->submit({num_, COMA, 0, target, 0});
+        } else {
+            target = random_other([this](int i) { return s_.count(i); });
+
+            slot_ = to_host_->submit({num_, COMA, 1, target, 0});
+            s_.insert(target);
+            check_ = target;
+        }
+    }
+};
+
+class Mana_policy : public Mana
+{
+public:
+    std::shared_ptr<const Policy> policy_;
+
+    Mana_policy (const int &num, Shared_ptr<Data> &data, Shared_ptr<Host_channel> &to_host,
+        const std::shared_ptr<const Policy> &policy)
+    {
+        num_ = num;
+        data_ = data;
+        to_host_ = to_host;
+        policy_ = policy;
+    }
+
+    void act(void) override {
+        int info = Policy::info(MANA, POL_NIGHT, phase_ / 2, live_count(), 0);
+
+        if (policy_pick(policy_or_uniform(policy_), info, 3) == 0)
+            return Mana::act();
+
+        // the most voted live seat of the last day
+        std::vector<int> count(data_->N_, 0);
+        int target = -1;
+
+        for (auto i : data_->last_vote_)
+            if (i != -1 && i != num_ && data_->is_live_[i] && ++count[i] > (target == -1 ? 0 : count[target]))
+                target = i;
+
+        if (target == -1)
+            return Mana::act();
+
+        to_host_->submit({num_, MANA, 0, target, 0});
+    }
+
+    void vote(void) override {
+        policy_vote(policy_or_uniform(policy_), MANA, 0, -1);
+    }
+};
+
+class Mafia_policy : public Mafia_focus
+{
+public:
+    std::shared_ptr<const Policy> policy_;
+
+    Mafia_policy (const int &num, Shared_ptr<Data> &data, Shared_ptr<Mafia_privat> & maf_priv,
+        const std::shared_ptr<const Policy> &policy)
+    {
+        num_ = num;
+        data_ = data;
+        maf_priv_ = maf_priv;
+        policy_ = policy;
+    }
+
+    // live bros, this one too, 1..privs_
+    int bros(void) const {
+        int n = 0;
+        for (int i : maf_priv_->roster_.seats())
+            n += data_->is_live_[i];
+        return std::min(n, Policy::privs_) - 1;
+    }
+
+    void act(void) override {
+        int info = Policy::info(MAFIA, POL_NIGHT, phase_ / 2, live_count(), bros());
+        int act = policy_pick(policy_or_uniform(policy_), info, 7);
+
+        if (act == 0)
+            return Mafia::act();
+        if (act == 1)
+            return Mafia_focus::act();
+
+        // one who voted for a bro the last day
+        const Roster &bro = maf_priv_->roster_;
+        int target = random_other([&](int i) {
+            return bro.count(i) || data_->last_vote_[i] == -1 || !bro.count(data_->last_vote_[i]);
+        });
+
+        if (target == -1)
+            return Mafia::act();
+
+        maf_priv_->vote(num_, target);
+        maf_priv_->bar_maf_vote_->arrive(num_);
+    }
+
+    void vote(void) override {
+        const Roster &bro = maf_priv_->roster_;
+        policy_vote(policy_or_uniform(policy_), MAFIA, bros(),
+            random_other([&](int i) { return bro.count(i); }));
+    }
+};
@@ -0,0 +1,241 @@
+#pragma once
+
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <dlfcn.h>
+
+#include "mafia_plugin.h"
+#include "players.hpp"
+
+// A loaded strategy plugin, see mafia_plugin.h. Loaded once per path and
+// kept until the program ends.
+class Plugin
+{
+    void *handle_;
+    const mafia_plugin *api_;
+    std::string path_;
+
+    Plugin (void *handle, const mafia_plugin *api, const std::string &path) :
+        handle_(handle),
+        api_(api),
+        path_(path)
+    {}
+
+public:
+    Plugin (const Plugin &) = delete;
+    Plugin &operator=(const Plugin &) = delete;
+
+    // nullptr and a message if it can't be used
+    static std::shared_ptr<Plugin> load(const std::string &path) {
+        static std::mutex mut;
+        static std::map<std::string, std::shared_ptr<Plugin>> loaded;
+
+        std::lock_guard<std::mutex> lg{mut};
+
+        if (loaded.count(path))
+            return loaded[path];
+
+        void *handle = dlopen(path.c_str(), RTLD_NOW | RTLD_LOCAL);
+        if (!handle) {
+            std::cout << "Can't load " << path << ": " << dlerror() << "\n";
+            return nullptr;
+        }
+
+        auto get = reinterpret_cast<mafia_plugin_get_t>(dlsym(handle, "mafia_plugin_get"));
+        const mafia_plugin *api = get ? get() : nullptr;
+
+        if (!api || api->abi != MAFIA_PLUGIN_ABI || !api->create || !api->destroy || !api->decide) {
+            std::cout << path << " is not a mafia plugin of abi " << MAFIA_PLUGIN_ABI << "\n";
+            dlclose(handle);
+            return nullptr;
+        }
+
+        std::shared_ptr<Plugin> p(new Plugin(handle, api, path));
+        loaded[path] = p;
+        return p;
+    }
+
+    const mafia_plugin &api(void) const {
+        return *api_;
+    }
+
+    const std::string &path(void) const {
+        return path_;
+    }
+
+    ~Plugin() {
+        dlclose(handle_);
+    }
+};
+
+// The seats of one role that one plugin plays in a game. decide() asks the
+// plugin for all of them at once, before the phase starts; the players
+// only pick up their move.
+class Plugin_group
+{
+    std::shared_ptr<Plugin> plugin_;
+    int role_;
+    void *state_;
+    std::vector<int> seats_;
+    std::vector<mafia_move> moves_;  // by seat
+    std::vector<uint8_t> live_;
+    std::vector<uint8_t> mafia_;
+
+public:
+    Plugin_group (const std::shared_ptr<Plugin> &plugin, const int &role, const int &N, const uint64_t &seed) :
+        plugin_(plugin),
+        role_(role),
+        state_(plugin->api().create(N, seed)),
+        moves_(N, {-1, 0}),
+        live_(N, 0)
+    {}
+
+    Plugin_group (const Plugin_group &) = delete;
+    Plugin_group &operator=(const Plugin_group &) = delete;
+
+    const Plugin *plugin(void) const {
+        return plugin_.get();
+    }
+
+    int role(void) const {
+        return role_;
+    }
+
+    void add(const int &seat) {
+        seats_.push_back(seat);
+    }
+
+    void know_mafia(const std::vector<int> &pers) {
+        mafia_.resize(pers.size());
+        for (size_t i = 0; i < pers.size(); ++i)
+            mafia_[i] = pers[i] == MAFIA;
+    }
+
+    void decide(const Data &data, const int &day, const int &phase) {
+        std::vector<int> ask;
+        std::vector<mafia_move> out;
+
+        for (int i = 0; i < data.N_; ++i)
+            live_[i] = data.is_live_[i];
+
+        for (auto i : seats_)
+            if (live_[i])
+                ask.push_back(i);
+
+        if (ask.empty())
+            return;
+
+        out.resize(ask.size(), {-1, 0});
+
+        mafia_view view{data.N_, day, phase, role_, live_.data(),
+            mafia_.empty() ? nullptr : mafia_.data()};
+
+        plugin_->api().decide(state_, &view, ask.size(), ask.data(), out.data());
+
+        for (size_t i = 0; i < ask.size(); ++i)
+            moves_[ask[i]] = out[i];
+    }
+
+    const mafia_move &move(const int &seat) const {
+        return moves_[seat];
+    }
+
+    void learn(const int &seat, const int &target, const bool &is_mafia) {
+        if (plugin_->api().learn)
+            plugin_->api().learn(state_, seat, target, is_mafia);
+    }
+
+    ~Plugin_group() {
+        plugin_->api().destroy(state_);
+    }
+};
+
+// A seat played by a plugin. Moves that break the rules are dropped, a
+// dropped day vote falls back to the random one of Player.
+class Plugin_player : public Player
+{
+    int role_;
+    Plugin_group *group_;
+    Shared_ptr<Host_channel> to_host_;
+    Shared_ptr<Mafia_privat> maf_priv_;
+    int prev_safe_{-1};
+    int check_{-1};
+    size_t slot_{0};
+
+    bool fits(const int &target) const {
+        return target >= 0 && target < data_->N_ && data_->is_live_[target];
+    }
+
+public:
+    Plugin_player (const int &role,
+        const int &num,
+        Shared_ptr<Data> &data,
+        Shared_ptr<Host_channel> &to_host,
+        Shared_ptr<Mafia_privat> &maf_priv,
+        Plugin_group *group)
+        :
+        Player(num, data),
+        role_(role),
+        group_(group),
+        to_host_(to_host),
+        maf_priv_(maf_priv)
+    {}
+
+    void act(void) override {
+        const mafia_move &m = group_->move(num_);
+        int target = m.target;
+
+        switch (role_) {
+            case DOC:
+                if (fits(target) && target != prev_safe_) {
+                    prev_safe_ = target;
+                    to_host_->submit({num_, DOC, 0, target, 0});
+                }
+                break;
+            case COMA:
+                if (fits(target) && target != num_) {
+                    slot_ = to_host_->submit({num_, COMA, m.check ? 1 : 0, target, 0});
+                    check_ = m.check ? target : -1;
+                }
+                break;
+            case MANA:
+                if (fits(target) && target != num_)
+                    to_host_->submit({num_, MANA, 0, target, 0});
+                break;
+            case MAFIA: {
+                if (fits(target) && target != num_ && !maf_priv_->roster_.count(target))
+                    maf_priv_->vote(num_, target);
+                maf_priv_->bar_maf_vote_->arrive(num_);
+                break;
+            }
+        }
+    }
+
+    void vote(void) override {
+        int target = group_->move(num_).target;
+
+        if (!fits(target) || target == num_)
+            return Player::vote();
+
+        std::lock_guard<std::mutex> lg{*data_->mut_vote_};
+        data_->vote_list_[num_] = target;
+    }
+
+    void act_res(void) override {
+        if (check_ == -1 || slot_ == Host_channel::full_)
+            return;
+
+        group_->learn(num_, check_, (*to_host_)[slot_].ans_);
+        check_ = -1;
+    }
+
+    void act_after_die(void) override {
+        if (role_ == MAFIA)
+            maf_priv_->bar_maf_vote_->arrive_and_drop(num_);
+    }
+};
@@ -0,0 +1,89 @@
+/*
+ * Example plugin: every seat picks a random live target that isn't itself
+ * (nor a bro for the mafia), Coma checks every other night and goes after
+ * the mafia it found. One xorshift state per group, the per seat loop has
+ * no calls.
+ */
+#include <stdlib.h>
+
+#include "mafia_plugin.h"
+
+typedef struct bot {
+    uint64_t rng;
+    int n;
+    uint8_t *found;   /* mafia found by the Coma */
+} bot;
+
+static uint32_t next(bot *b) {
+    b->rng ^= b->rng << 13;
+    b->rng ^= b->rng >> 7;
+    b->rng ^= b->rng << 17;
+    return b->rng >> 32;
+}
+
+static void *create(int n, uint64_t seed) {
+    bot *b = calloc(1, sizeof(bot));
+
+    b->rng = seed | 1;
+    b->n = n;
+    b->found = calloc(n, 1);
+    return b;
+}
+
+static void destroy(void *state) {
+    bot *b = state;
+
+    free(b->found);
+    free(b);
+}
+
+static void decide(void *state, const mafia_view *v, int count, const int *seats, mafia_move *out) {
+    bot *b = state;
+    int live = 0;
+
+    for (int s = 0; s < v->n; ++s)
+        live += v->live[s];
+
+    for (int i = 0; i < count; ++i) {
+        int target = -1;
+
+        out[i].check = 0;
+
+        if (v->role == MAFIA_COMA) {
+            for (int s = 0; s < v->n && target == -1; ++s)
+                if (b->found[s] && v->live[s])
+                    target = s;
+            out[i].check = target == -1 && v->phase == MAFIA_NIGHT && (v->day & 1);
+        }
+
+        /* a few tries are enough, -1 lets the engine pick */
+        for (int t = 0; t < 8 && target == -1 && live > 1; ++t) {
+            int s = (uint64_t)next(b) * v->n >> 32;
+
+            if (v->live[s] && s != seats[i] && !(v->mafia && v->mafia[s]))
+                target = s;
+        }
+
+        out[i].target = target;
+    }
+}
+
+static void learn(void *state, int seat, int target, int is_mafia) {
+    bot *b = state;
+
+    (void)seat;
+    b->found[target] = is_mafia;
+}
+
+static const mafia_plugin plugin = {
+    MAFIA_PLUGIN_ABI,
+    "random_bot",
+    create,
+    destroy,
+    decide,
+    learn,
+};
+
+const mafia_plugin *mafia_plugin_get(void) {
+    return &plugin;
+}
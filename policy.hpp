@@ -0,0 +1,166 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+// Mixed strategy tables of every role for small lobbies, written by the
+// Cfr solver and played by the STRAT_POLICY bots. A table row is an
+// abstract information set: the role, night or vote, the day, how many
+// seats are live and a few bits the seat knows privately. The actions are
+// kinds of target, the bot picks the seat of the kind itself.
+//
+// File: "mafia policy <version>", then one line per row that was reached,
+// role phase day live priv p0 p1 p2; '#' starts a comment.
+
+enum Policy_phase
+{
+    POL_NIGHT,
+    POL_VOTE,
+};
+
+// the actions of a role in a phase, by Roles; "" is none
+const char *const policy_act_names[2][5][3] = {
+    {
+        {"", "", ""},                     // civilian sleeps
+        {"random", "self", ""},           // doc saves
+        {"kill", "check", ""},            // coma, kills a mafia it found first
+        {"random", "accused", ""},        // mana, the most voted of the last day
+        {"random", "focus", "accuser"},   // mafia, one who voted for a bro
+    },
+    {
+        {"random", "herd", ""},
+        {"random", "herd", ""},
+        {"random", "herd", "found"},      // the mafia the coma found
+        {"random", "herd", ""},
+        {"random", "herd", "outsider"},   // any live seat but a bro
+    },
+};
+
+struct Policy
+{
+    static constexpr int version_ = 1;
+    static constexpr int acts_ = 3;
+    static constexpr int roles_ = 5;
+    static constexpr int days_ = 4;      // the last one is every later day too
+    static constexpr int lives_ = 16;    // the same for live seats
+    static constexpr int privs_ = 4;
+    static constexpr int infos_ = roles_ * 2 * days_ * lives_ * privs_;
+
+    std::vector<float> p_;           // infos_ x acts_, by row
+    double eps_{0};                  // > 0 - being learned, the exploration of the learning seat
+
+    Policy () :
+        p_(size_t(infos_) * acts_, 1.0f / acts_)
+    {}
+
+    static int info(const int &role, const int &phase, const int &day, const int &live, const int &priv) {
+        return (((role * 2 + phase) * days_ + std::min(day, days_ - 1)) * lives_ +
+            std::min(live, lives_ - 1)) * privs_ + priv;
+    }
+
+    // role, phase, day, live, priv of a row
+    static void split(int info, int f[5]) {
+        f[4] = info % privs_, info /= privs_;
+        f[3] = info % lives_, info /= lives_;
+        f[2] = info % days_, info /= days_;
+        f[1] = info % 2;
+        f[0] = info / 2;
+    }
+
+    const float *at(const int &info) const {
+        return p_.data() + size_t(info) * acts_;
+    }
+
+    float *at(const int &info) {
+        return p_.data() + size_t(info) * acts_;
+    }
+
+    // rows - the ones to write, the rest are left at their defaults
+    bool save(const std::string &path, const std::vector<bool> &rows) const {
+        std::ofstream out(path);
+        if (!out)
+            return false;
+
+        out << "mafia policy " << version_ << "\n";
+        out << "# role phase day live priv p...\n";
+
+        int last = -1;
+        for (int i = 0; i < infos_; ++i) {
+            if (!rows[i])
+                continue;
+
+            int f[5];
+            split(i, f);
+
+            if (f[0] * 2 + f[1] != last) {
+                const char *const *names = policy_act_names[f[1]][f[0]];
+                out << "# role " << f[0] << (f[1] == POL_NIGHT ? " night:" : " vote:");
+                for (int a = 0; a < acts_ && *names[a]; ++a)
+                    out << " " << names[a];
+                out << "\n";
+                last = f[0] * 2 + f[1];
+            }
+
+            char line[128];
+            snprintf(line, sizeof(line), "%d %d %d %d %d %.4f %.4f %.4f\n",
+                f[0], f[1], f[2], f[3], f[4], at(i)[0], at(i)[1], at(i)[2]);
+            out << line;
+        }
+
+        return bool(out);
+    }
+
+    bool load(const std::string &path) {
+        std::ifstream in(path);
+        std::string line;
+        int version = 0;
+
+        if (!std::getline(in, line) || sscanf(line.c_str(), "mafia policy %d", &version) != 1 ||
+                version != version_)
+            return false;
+
+        while (std::getline(in, line)) {
+            if (line.empty() || line[0] == '#')
+                continue;
+
+            std::istringstream ls(line);
+            int f[5];
+            float p[acts_];
+
+            for (auto &x : f)
+                ls >> x;
+            for (auto &x : p)
+                ls >> x;
+
+            if (!ls || f[0] < 0 || f[0] >= roles_ || f[1] < 0 || f[1] > 1 || f[2] < 0 || f[2] >= days_ ||
+                    f[3] < 0 || f[3] >= lives_ || f[4] < 0 || f[4] >= privs_)
+                return false;
+
+            std::copy(p, p + acts_, at(info(f[0], f[1], f[2], f[3], f[4])));
+        }
+
+        return true;
+    }
+};
+
+// The learning seat of a game played while a Policy is learned, and what
+// it did
+struct Policy_step
+{
+    int info_;
+    int act_;
+    uint8_t legal_;   // the actions it had, by bit
+    float q_;         // the chance it took act_ with
+};
+
+struct Policy_learn
+{
+    int seat_;
+    int role_;
+    std::vector<Policy_step> steps_;
+};
@@ -0,0 +1,77 @@
+#pragma once
+
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "trace.hpp"
+
+// Process wide worker pool, one thread per core. Tasks must never wait for
+// each other: a game keeps its phase order by scheduling the next phase
+// from the task that finishes the previous one.
+class Pool
+{
+    std::vector<std::thread> workers_;
+    std::deque<std::function<void(void)>> tasks_;
+    std::mutex mut_;
+    std::condition_variable cv_;
+    bool stop_{false};
+
+    void worker_loop(int num) {
+        tracer().name_thread("worker " + std::to_string(num));
+
+        while (true) {
+            std::unique_lock<std::mutex> ul{mut_};
+            cv_.wait(ul, [this] { return stop_ || !tasks_.empty(); });
+
+            if (tasks_.empty())
+                return;
+
+            auto task = std::move(tasks_.front());
+            tasks_.pop_front();
+            ul.unlock();
+
+            task();
+        }
+    }
+
+public:
+    Pool (int threads = 0) {
+        if (threads <= 0)
+            threads = std::max(1u, std::thread::hardware_concurrency());
+
+        for (int i = 0; i < threads; ++i)
+            workers_.push_back(std::thread{&Pool::worker_loop, this, i});
+    }
+
+    Pool (const Pool &) = delete;
+    Pool &operator=(const Pool &) = delete;
+
+    int size(void) const {
+        return workers_.size();
+    }
+
+    void submit(std::function<void(void)> task) {
+        std::unique_lock<std::mutex> ul{mut_};
+        tasks_.push_back(std::move(task));
+        ul.unlock();
+
+        cv_.notify_one();
+    }
+
+    // runs what is queued and joins the workers
+    ~Pool() {
+        std::unique_lock<std::mutex> ul{mut_};
+        stop_ = true;
+        ul.unlock();
+
+        cv_.notify_all();
+
+        for (auto &i : workers_)
+            i.join();
+    }
+};
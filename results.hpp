@@ -0,0 +1,442 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "players.hpp"
+
+// Columnar results of a simulation run.
+//
+// file   := "MFR1" chunk*
+// chunk  := "CHNK" table:u8 rows:u32 cols:u8 column*
+// column := id:u8 enc:u8 bytes:u32 payload[bytes]
+//
+// A chunk holds about Results_writer::chunk_rows_ rows written by one
+// thread, the kills of the game that fills it go in whole. Every column is compressed on its own with whichever encoding
+// is the smallest for it, so a reader seeks over the columns it doesn't
+// need and decodes only the ones it asked for.
+
+enum Res_table
+{
+    RES_GAMES,
+    RES_KILLS,
+};
+
+enum Res_enc
+{
+    ENC_DELTA, // zigzag deltas as varints
+    ENC_RLE,   // (value, run) varints
+    ENC_BITS,  // fixed width bit packing
+};
+
+struct Res_col
+{
+    const char *name_;
+    int table_;
+};
+
+// column id is the index in res_cols for its table
+const std::vector<std::vector<Res_col>> res_cols = {
+    {
+        {"seed", RES_GAMES},
+        {"N", RES_GAMES},
+        {"mafia_count", RES_GAMES},
+        {"winner", RES_GAMES},
+        {"days", RES_GAMES},
+        {"kills_mana", RES_GAMES},
+        {"kills_coma", RES_GAMES},
+        {"kills_mafia", RES_GAMES},
+        {"kicks", RES_GAMES},
+        {"saves", RES_GAMES},
+        {"docs", RES_GAMES},
+        {"comas", RES_GAMES},
+        {"manas", RES_GAMES},
+    },
+    {
+        {"game", RES_KILLS},   // seed of the game
+        {"day", RES_KILLS},
+        {"killer", RES_KILLS}, // MANA, COMA, MAFIA or VOTE
+        {"victim", RES_KILLS},
+        {"victim_role", RES_KILLS},
+    },
+};
+
+void put_varint(std::string &out, uint64_t v) {
+    while (v >= 0x80) {
+        out.push_back(char(v | 0x80));
+        v >>= 7;
+    }
+    out.push_back(char(v));
+}
+
+// false if the varint runs past end or 64 bits
+bool get_varint(const char *&p, const char *end, uint64_t &v) {
+    v = 0;
+
+    for (int shift = 0; p < end && shift < 64; shift += 7) {
+        uint8_t b = *p++;
+        v |= uint64_t(b & 0x7f) << shift;
+        if (!(b & 0x80))
+            return true;
+    }
+
+    return false;
+}
+
+std::string encode_col(const std::vector<uint64_t> &v, uint8_t &enc) {
+    std::string delta, rle, bits;
+
+    uint64_t prev = 0;
+    for (auto i : v) {
+        int64_t d = int64_t(i - prev);
+        put_varint(delta, (uint64_t(d) << 1) ^ uint64_t(d >> 63));
+        prev = i;
+    }
+
+    for (size_t i = 0; i < v.size(); ) {
+        size_t j = i;
+        while (j < v.size() && v[j] == v[i])
+            ++j;
+        put_varint(rle, v[i]);
+        put_varint(rle, j - i);
+        i = j;
+    }
+
+    uint64_t all = 0;
+    for (auto i : v)
+        all |= i;
+
+    int width = 0;
+    while (width < 64 && (all >> width))
+        ++width;
+
+    bits.push_back(char(width));
+    uint64_t acc = 0;
+    int fill = 0;
+    for (auto i : v) {
+        for (int b = 0; b < width; ++b) {
+            acc |= ((i >> b) & 1) << fill;
+            if (++fill == 8) {
+                bits.push_back(char(acc));
+                acc = 0;
+                fill = 0;
+            }
+        }
+    }
+    if (fill)
+        bits.push_back(char(acc));
+
+    if (delta.size() <= rle.size() && delta.size() <= bits.size()) {
+        enc = ENC_DELTA;
+        return delta;
+    }
+
+    if (rle.size() <= bits.size()) {
+        enc = ENC_RLE;
+        return rle;
+    }
+
+    enc = ENC_BITS;
+    return bits;
+}
+
+// false if data doesn't hold rows values of enc
+bool decode_col(const uint8_t &enc, const std::string &data, const size_t &rows, std::vector<uint64_t> &v) {
+    const char *p = data.data(), *end = p + data.size();
+
+    v.clear();
+    v.reserve(rows);
+
+    switch (enc) {
+        case ENC_DELTA: {
+            uint64_t prev = 0, z;
+            for (size_t i = 0; i < rows; ++i) {
+                if (!get_varint(p, end, z))
+                    return false;
+                prev += (z >> 1) ^ (~(z & 1) + 1);
+                v.push_back(prev);
+            }
+            return true;
+        }
+        case ENC_RLE:
+            while (v.size() < rows) {
+                uint64_t val, run;
+                if (!get_varint(p, end, val) || !get_varint(p, end, run))
+                    return false;
+                v.insert(v.end(), std::min<uint64_t>(run, rows - v.size()), val);
+            }
+            return true;
+        case ENC_BITS: {
+            if (p == end)
+                return false;
+
+            int width = uint8_t(*p++);
+            if (width > 64 || uint64_t(end - p) * 8 < uint64_t(width) * rows)
+                return false;
+
+            size_t bit = 0;
+            for (size_t i = 0; i < rows; ++i) {
+                uint64_t val = 0;
+                for (int b = 0; b < width; ++b, ++bit)
+                    val |= uint64_t((uint8_t(p[bit / 8]) >> (bit % 8)) & 1) << b;
+                v.push_back(val);
+            }
+            return true;
+        }
+    }
+
+    return false;
+}
+
+class Results_writer
+{
+public:
+    static const size_t chunk_rows_ = 1 << 14;
+    static const size_t max_rows_ = 1 << 24;   // of a chunk a reader takes
+
+private:
+    struct Res_buf
+    {
+        std::vector<uint64_t> cols_[2][13];
+    };
+
+    std::ofstream out_;
+    std::mutex mut_;
+    std::vector<std::unique_ptr<Res_buf>> bufs_;
+    uint64_t id_;
+    long long games_{0};
+
+    static uint64_t next_id(void) {
+        static std::atomic<uint64_t> id{0};
+        return ++id;
+    }
+
+    // each thread fills its own rows, only whole chunks take the lock
+    Res_buf *local(void) {
+        static thread_local uint64_t owner = 0;
+        static thread_local Res_buf *buf = nullptr;
+
+        if (owner != id_) {
+            std::lock_guard<std::mutex> lg{mut_};
+            bufs_.push_back(std::make_unique<Res_buf>());
+            buf = bufs_.back().get();
+            owner = id_;
+        }
+
+        return buf;
+    }
+
+    void write_chunk(Res_buf *buf, const int &table) {
+        auto &cols = buf->cols_[table];
+        size_t rows = cols[0].size();
+        int ncols = res_cols[table].size();
+
+        if (!rows)
+            return;
+
+        std::string chunk = "CHNK";
+        chunk.push_back(char(table));
+        chunk.append(reinterpret_cast<const char *>(&rows), 4);
+        chunk.push_back(char(ncols));
+
+        for (int c = 0; c < ncols; ++c) {
+            uint8_t enc;
+            std::string data = encode_col(cols[c], enc);
+            uint32_t bytes = data.size();
+
+            chunk.push_back(char(c));
+            chunk.push_back(char(enc));
+            chunk.append(reinterpret_cast<const char *>(&bytes), 4);
+            chunk += data;
+            cols[c].clear();
+        }
+
+        std::lock_guard<std::mutex> lg{mut_};
+        out_.write(chunk.data(), chunk.size());
+    }
+
+public:
+    Results_writer (const std::string &path) :
+        out_(path, std::ios::binary),
+        id_(next_id())
+    {
+        out_.write("MFR1", 4);
+    }
+
+    Results_writer (const Results_writer &) = delete;
+    Results_writer &operator=(const Results_writer &) = delete;
+
+    bool good(void) const {
+        return bool(out_);
+    }
+
+    void add(const Game_rec &rec) {
+        Res_buf *buf = local();
+        auto &g = buf->cols_[RES_GAMES];
+        auto &k = buf->cols_[RES_KILLS];
+
+        g[0].push_back(rec.seed_);
+        g[1].push_back(rec.N_);
+        g[2].push_back(rec.mafia_count_);
+        g[3].push_back(rec.winner_);
+        g[4].push_back(rec.days_);
+        g[5].push_back(rec.kills_[MANA]);
+        g[6].push_back(rec.kills_[COMA]);
+        g[7].push_back(rec.kills_[MAFIA]);
+        g[8].push_back(rec.kills_[VOTE]);
+        g[9].push_back(rec.saves_);
+        g[10].push_back(rec.doc_count_);
+        g[11].push_back(rec.coma_count_);
+        g[12].push_back(rec.mana_count_);
+
+        for (auto &i : rec.kill_list_) {
+            k[0].push_back(rec.seed_);
+            k[1].push_back(i.day_);
+            k[2].push_back(i.killer_);
+            k[3].push_back(i.victim_);
+            k[4].push_back(i.victim_role_);
+        }
+
+        if (g[0].size() >= chunk_rows_)
+            write_chunk(buf, RES_GAMES);
+        if (k[0].size() >= chunk_rows_)
+            write_chunk(buf, RES_KILLS);
+    }
+
+    // call once no thread adds any more
+    void close(void) {
+        for (auto &i : bufs_) {
+            write_chunk(i.get(), RES_GAMES);
+            write_chunk(i.get(), RES_KILLS);
+        }
+
+        out_.flush();
+    }
+
+    ~Results_writer() {
+        close();
+    }
+};
+
+// Reads only the named columns (of one table). One column prints the
+// number of rows per value, two columns the number of rows per pair,
+// e.g. "N winner" gives the winners by lobby size.
+bool scan_results(const std::string &path, const std::vector<std::string> &names) {
+    int table = -1;
+    std::vector<int> want;
+
+    for (auto &n : names) {
+        for (int t = 0; t < (int)res_cols.size(); ++t) {
+            for (int c = 0; c < (int)res_cols[t].size(); ++c) {
+                if (n == res_cols[t][c].name_ && (table == -1 || table == t)) {
+                    table = t;
+                    want.push_back(c);
+                }
+            }
+        }
+    }
+
+    if (want.size() != names.size() || want.empty() || want.size() > 2) {
+        std::cout << "Columns of one table, one or two of them:\n";
+        for (auto &t : res_cols) {
+            for (auto &c : t)
+                std::cout << c.name_ << " ";
+            std::cout << "\n";
+        }
+        return false;
+    }
+
+    std::ifstream in(path, std::ios::binary);
+    char magic[4];
+
+    if (!in.read(magic, 4) || std::memcmp(magic, "MFR1", 4)) {
+        std::cout << "Not a results file\n";
+        return false;
+    }
+
+    std::map<std::pair<uint64_t, uint64_t>, long long> count;
+    long long rows_all = 0;
+
+    // a torn or damaged chunk ends the scan, what came before it counts
+    auto bad = [&] {
+        std::cout << "Damaged chunk after " << rows_all << " rows, the rest is skipped\n";
+    };
+
+    while (in.read(magic, 4)) {
+        uint8_t t, ncols;
+        uint32_t rows;
+
+        if (std::memcmp(magic, "CHNK", 4) || !in.read(reinterpret_cast<char *>(&t), 1) ||
+                !in.read(reinterpret_cast<char *>(&rows), 4) || !in.read(reinterpret_cast<char *>(&ncols), 1) ||
+                rows > Results_writer::max_rows_) {
+            bad();
+            break;
+        }
+
+        std::vector<std::vector<uint64_t>> got(want.size());
+        bool ok = true;
+
+        for (int c = 0; c < ncols && ok; ++c) {
+            uint8_t id, enc;
+            uint32_t bytes;
+
+            // no encoding takes over 20 bytes a row
+            if (!in.read(reinterpret_cast<char *>(&id), 1) || !in.read(reinterpret_cast<char *>(&enc), 1) ||
+                    !in.read(reinterpret_cast<char *>(&bytes), 4) || bytes > 20 * uint64_t(rows) + 16) {
+                ok = false;
+                break;
+            }
+
+            bool need = false;
+            for (size_t w = 0; w < want.size(); ++w) {
+                if (t == table && id == want[w]) {
+                    std::string data(bytes, '\0');
+                    ok = in.read(data.data(), bytes) && decode_col(enc, data, rows, got[w]);
+                    need = true;
+                    break;
+                }
+            }
+
+            if (!need)
+                ok = bool(in.seekg(bytes, std::ios::cur));
+        }
+
+        if (!ok) {
+            bad();
+            break;
+        }
+
+        if (t != table)
+            continue;
+
+        // files from before a column was added don't have it
+        bool all = true;
+        for (auto &g : got)
+            all &= g.size() == rows;
+        if (!all)
+            continue;
+
+        rows_all += rows;
+        for (uint32_t r = 0; r < rows; ++r)
+            ++count[{got[0][r], want.size() > 1 ? got[1][r] : 0}];
+    }
+
+    std::cout << "Rows " << rows_all << "\n";
+    for (auto &i : count) {
+        std::cout << i.first.first;
+        if (want.size() > 1)
+            std::cout << " " << i.first.second;
+        std::cout << " " << i.second << "\n";
+    }
+    std::cout.flush();
+
+    return true;
+}
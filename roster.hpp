@@ -0,0 +1,75 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+// Set of seats as bits, N / 8 bytes; grows on insert, seats past the end
+// are not in it
+class Seat_bits
+{
+    std::vector<uint64_t> w_;
+
+public:
+    Seat_bits () = default;
+
+    explicit Seat_bits (const int &N) :
+        w_((N + 63) / 64, 0)
+    {}
+
+    bool count(const int &seat) const {
+        size_t w = size_t(seat) >> 6;
+        return w < w_.size() && (w_[w] >> (seat & 63) & 1);
+    }
+
+    void insert(const int &seat) {
+        size_t w = size_t(seat) >> 6;
+        if (w >= w_.size())
+            w_.resize(w + 1, 0);
+        w_[w] |= uint64_t(1) << (seat & 63);
+    }
+
+    void erase(const int &seat) {
+        size_t w = size_t(seat) >> 6;
+        if (w < w_.size())
+            w_[w] &= ~(uint64_t(1) << (seat & 63));
+    }
+};
+
+// The seats of one role, fixed at the deal. One per game, shared read only
+// by the members instead of a copy each.
+class Roster
+{
+    Seat_bits bits_;
+    std::vector<int> seats_;   // in seat order
+
+public:
+    Roster (const std::vector<int> &pers, const int &role) :
+        bits_(pers.size())
+    {
+        for (size_t i = 0; i < pers.size(); ++i)
+            if (pers[i] == role) {
+                bits_.insert(i);
+                seats_.push_back(i);
+            }
+    }
+
+    bool count(const int &seat) const {
+        return bits_.count(seat);
+    }
+
+    // place of the seat in seats(), -1 if it isn't in
+    int index(const int &seat) const {
+        if (!count(seat))
+            return -1;
+        return std::lower_bound(seats_.begin(), seats_.end(), seat) - seats_.begin();
+    }
+
+    const std::vector<int> &seats(void) const {
+        return seats_;
+    }
+
+    int size(void) const {
+        return seats_.size();
+    }
+};
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "game.hpp"
+
+// Scripted load on the interactive path: whole threaded games as at the
+// terminal, the first `humans` seats played by the _cmd players from a
+// script, all at full speed. Every human seat starts the script at a line
+// of its own and goes on over the games. The game's own output goes to
+// out_path, the timing to std::cout: games/s and, per phase, the latency
+// from prompt to answer and from prompt to the host's result, where
+// barrier stalls and slow output show.
+void run_script(const Config &conf,
+    const std::shared_ptr<const std::vector<std::vector<std::string>>> &lines,
+    const long long &games,
+    const int &humans,
+    const uint64_t &seed,
+    const bool &op_cl_info,
+    const std::string &out_path = "/dev/null")
+{
+    using clock = std::chrono::steady_clock;
+
+    std::ofstream out(out_path);
+    if (!out) {
+        std::cout << "Can't write " << out_path << "\n";
+        return;
+    }
+
+    for (int i = 0; i < humans; ++i)
+        cmd_io().set_input(i, std::make_unique<Script_input>(lines, i * lines->size() / humans));
+
+    cmd_io().enable(conf.N_);
+
+    long long wins[4] = {0, 0, 0, 0};
+    std::vector<bool> cmd(conf.N_, false);
+    std::fill_n(cmd.begin(), humans, true);
+
+    std::streambuf *cout_buf = std::cout.rdbuf(out.rdbuf());
+    auto begin = clock::now();
+
+    for (long long g = 0; g < games; ++g) {
+        Rng rng(seed + g);
+        std::vector<int> pers = deal_roles(conf, rng);
+
+        ++wins[play_threaded(conf, pers, cmd, seed + g, op_cl_info).winner_ & 3];
+    }
+
+    double sec = std::chrono::duration<double>(clock::now() - begin).count();
+    std::cout.rdbuf(cout_buf);
+
+    for (int i = 0; i < humans; ++i)
+        cmd_io().set_input(i, nullptr);
+
+    std::cout << "Games " << games << ", civ " << wins[1] << " maf " << wins[2] << " mana " << wins[3]
+        << ", " << humans << " scripted seats, " << sec << " s, " << games / sec << " games/s\n";
+    cmd_io().print(std::cout);
+}
@@ -1,3 +1,5 @@
+#pragma once
+
 #include <iostream>
 #include <cstdlib>
 #include <ctime>
@@ -33,6 +35,7 @@ public:
 
     Shared_ptr(T *ptr) {
         cptr_ = new ControlBlock<T>(1, *ptr);
+        delete ptr;
     }
 
     Shared_ptr(const Shared_ptr& other) {
@@ -100,9 +103,10 @@ public:
                 delete cptr_;
         }
             
-        if (ptr)
+        if (ptr) {
             cptr_ = new ControlBlock<T>(1, *ptr);
-        else
+            delete ptr;
+        } else
             cptr_ = nullptr;
     }
 
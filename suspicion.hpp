@@ -0,0 +1,154 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <deque>
+#include <vector>
+
+// Public suspicion of every seat, from the day votes and the night
+// victims, one per game for all of its STRAT_SUSPECT bots. A[i][j] is how
+// much i and j played as one team: voting for the same seat adds 1,
+// voting for the other takes 1 off, and every vote fades the older ones
+// by decay_. A night victim is taken for a civilian, so the seats that
+// sided with it look clean and the ones that voted against it look
+// suspect: score[j] = -sum over victims k of A[k][j].
+//
+// Up to dense_max_ seats A is a dense float matrix, updated by tiles of
+// rows and columns in one branchless pass the compiler vectorizes. Above
+// it, A is kept factored as the targets of the last window_ votes: a
+// vote's matrix has rank at most the number of seats voted for, and the
+// scores come out of per target counts in O(N) per vote, O(N window_)
+// memory in all. The forms agree up to window_ votes; past that the
+// factored one drops the oldest, which weigh decay_^window_ (1e-3 at 0.8)
+// of the newest, so the top seats of a long game can differ.
+class Suspicion
+{
+    static const int dense_max_ = 1024;
+    static const int window_ = 32;
+    static const int tile_rows_ = 64;
+    static const int tile_cols_ = 1024;   // a tile row of targets stays in L1
+
+    int N_;
+    bool dense_;
+    float decay_;
+    std::vector<float> a_;                 // dense, N_ x N_ by rows
+    std::deque<std::vector<int>> votes_;   // factored, newest last
+    std::vector<int> victims_;
+    std::vector<float> score_;
+    std::vector<int> top_;                 // the live seats of the top score
+
+    void vote_dense(const int *__restrict vt) {
+        for (int i0 = 0; i0 < N_; i0 += tile_rows_)
+            for (int j0 = 0; j0 < N_; j0 += tile_cols_) {
+                int i1 = std::min(i0 + tile_rows_, N_);
+                int j1 = std::min(j0 + tile_cols_, N_);
+
+                for (int i = i0; i < i1; ++i) {
+                    float *__restrict row = a_.data() + size_t(i) * N_;
+                    const int vi = vt[i];
+                    const float d = decay_;
+
+                    for (int j = j0; j < j1; ++j)
+                        row[j] = d * row[j] + float((vi >= 0) & (vi == vt[j]))
+                            - float(vi == j) - float(vt[j] == i);
+                }
+            }
+    }
+
+    void score_dense(void) {
+        std::fill(score_.begin(), score_.end(), 0.0f);
+
+        for (int k : victims_) {
+            const float *__restrict row = a_.data() + size_t(k) * N_;
+            float *__restrict s = score_.data();
+
+            for (int j = 0; j < N_; ++j)
+                s[j] -= row[j];
+        }
+    }
+
+    // sum over victims k of [vt[k] == vt[j]] - [vt[k] == j] - [vt[j] == k],
+    // newest vote weight 1
+    void score_factored(void) {
+        std::vector<int> cnt(N_);
+        std::vector<uint8_t> victim(N_, 0);
+        float w = 1;
+
+        for (int k : victims_)
+            victim[k] = 1;
+
+        std::fill(score_.begin(), score_.end(), 0.0f);
+
+        for (auto v = votes_.rbegin(); v != votes_.rend(); ++v, w *= decay_) {
+            const std::vector<int> &vt = *v;
+
+            std::fill(cnt.begin(), cnt.end(), 0);
+            for (int k : victims_)
+                if (vt[k] >= 0)
+                    ++cnt[vt[k]];
+
+            for (int j = 0; j < N_; ++j) {
+                int a = (vt[j] >= 0 ? cnt[vt[j]] : 0) - cnt[j] - (vt[j] >= 0 && victim[vt[j]]);
+                score_[j] -= w * a;
+            }
+        }
+    }
+
+public:
+    Suspicion (const int &N, const float &decay = 0.8f) :
+        N_(N),
+        dense_(N <= dense_max_),
+        decay_(decay),
+        score_(N, 0.0f)
+    {
+        if (dense_)
+            a_.assign(size_t(N_) * N_, 0.0f);
+    }
+
+    bool dense(void) const {
+        return dense_;
+    }
+
+    // vt - the vote target of every seat, -1 for none
+    void vote(const std::vector<int> &vt) {
+        if (dense_) {
+            vote_dense(vt.data());
+            return;
+        }
+
+        votes_.push_back(vt);
+        if (votes_.size() > size_t(window_))
+            votes_.pop_front();
+    }
+
+    void victim(const int &seat) {
+        victims_.push_back(seat);
+    }
+
+    // after the votes and victims of a phase, before the bots read it
+    void update(const std::vector<bool> &live) {
+        if (dense_)
+            score_dense();
+        else
+            score_factored();
+
+        top_.clear();
+        for (int j = 0; j < N_; ++j) {
+            if (!live[j])
+                continue;
+            if (!top_.empty() && score_[j] > score_[top_[0]])
+                top_.clear();
+            if (top_.empty() || score_[j] == score_[top_[0]])
+                top_.push_back(j);
+        }
+    }
+
+    // higher is more suspect
+    const std::vector<float> &score(void) const {
+        return score_;
+    }
+
+    const std::vector<int> &top(void) const {
+        return top_;
+    }
+};
@@ -0,0 +1,201 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <csignal>
+#include <cstdint>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "game.hpp"
+
+// Tournament over worker processes. The coordinator maps an anonymous
+// shared region before it forks, every worker plays its own range of game
+// seeds on its own pool and adds each finished game to the counters and
+// histograms of the region with relaxed atomics. The coordinator only reads
+// the region, so a crashed worker takes nothing but its own games with it.
+
+const int shard_days_ = 64;    // days histogram, the last bucket is "or more"
+const int shard_lat_ = 32;     // latency histogram, bucket b is < 2^b us
+
+struct Shard_worker
+{
+    std::atomic<long long> done_;
+    std::atomic<int> pid_;
+};
+
+struct Shard_stats
+{
+    std::atomic<long long> done_;
+    std::atomic<long long> wins_[4];
+    std::atomic<long long> days_;
+    std::atomic<long long> kills_[VOTE + 1];
+    std::atomic<long long> saves_;
+    std::atomic<long long> days_hist_[shard_days_];
+    std::atomic<long long> lat_hist_[shard_lat_];
+    Shard_worker workers_[1]; // workers_count of them
+
+    static size_t bytes(const int &workers) {
+        return sizeof(Shard_stats) + (workers - 1) * sizeof(Shard_worker);
+    }
+
+    void add(const Game_rec &rec, const double &ms, const int &worker) {
+        wins_[rec.winner_].fetch_add(1, std::memory_order_relaxed);
+        days_.fetch_add(rec.days_, std::memory_order_relaxed);
+        for (int i = 0; i <= VOTE; ++i)
+            if (rec.kills_[i])
+                kills_[i].fetch_add(rec.kills_[i], std::memory_order_relaxed);
+        saves_.fetch_add(rec.saves_, std::memory_order_relaxed);
+        days_hist_[std::min(rec.days_, shard_days_ - 1)].fetch_add(1, std::memory_order_relaxed);
+
+        int b = 0;
+        for (long long us = ms * 1000; us > 0 && b < shard_lat_ - 1; us >>= 1)
+            ++b;
+        lat_hist_[b].fetch_add(1, std::memory_order_relaxed);
+
+        workers_[worker].done_.fetch_add(1, std::memory_order_relaxed);
+        // last, so a reader never sees more games than counted wins
+        done_.fetch_add(1, std::memory_order_release);
+    }
+};
+
+static_assert(std::atomic<long long>::is_always_lock_free, "shared counters need lock free atomics");
+
+// upper bound in ms of the latency bucket holding the q-th game
+double shard_quantile(const Shard_stats &st, const double &q) {
+    long long all = 0;
+    for (int b = 0; b < shard_lat_; ++b)
+        all += st.lat_hist_[b].load(std::memory_order_relaxed);
+
+    long long want = all * q;
+    long long seen = 0;
+    for (int b = 0; b < shard_lat_; ++b) {
+        seen += st.lat_hist_[b].load(std::memory_order_relaxed);
+        if (seen > want)
+            return double(uint64_t(1) << b) / 1000;
+    }
+
+    return 0;
+}
+
+void print_shard(const Shard_stats &st, const long long &games, const double &sec) {
+    long long done = st.done_.load(std::memory_order_acquire);
+
+    std::cout << "Done " << done << "/" << games << ", " << sec << " s, "
+        << (sec > 0 ? done / sec : 0) << " games/s, civ " << st.wins_[1].load()
+        << " maf " << st.wins_[2].load() << " mana " << st.wins_[3].load()
+        << ", p50 <" << shard_quantile(st, 0.5) << " ms p99 <" << shard_quantile(st, 0.99) << " ms\n";
+    std::cout.flush();
+}
+
+// Plays `games` games of conf on `workers` processes of `threads` threads
+// each; worker w plays seeds seed + [w * games / workers, (w + 1) * games / workers).
+// Prints the totals every report_ms. Returns the number of crashed workers.
+int run_tournament(const long long &games,
+    const Config &conf,
+    int workers,
+    const int &threads,
+    const uint64_t &seed,
+    const int &report_ms = 1000)
+{
+    using clock = std::chrono::steady_clock;
+
+    if (workers <= 0)
+        workers = std::thread::hardware_concurrency();
+
+    size_t bytes = Shard_stats::bytes(workers);
+    void *mem = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (mem == MAP_FAILED) {
+        std::cout << "mmap failed\n";
+        return workers;
+    }
+
+    // a fresh anonymous mapping is zeroed, which is what the atomics start at
+    Shard_stats *st = static_cast<Shard_stats *>(mem);
+
+    std::cout << "Tournament " << games << " games on " << workers << " workers, seed " << seed << "\n";
+    std::cout.flush();
+
+    auto begin = clock::now();
+
+    for (int w = 0; w < workers; ++w) {
+        long long from = games * w / workers;
+        long long to = games * (w + 1) / workers;
+
+        pid_t pid = fork();
+
+        if (pid == 0) {
+            // only the forking thread exists here, the pool is made afresh
+            {
+                Pool pool(threads);
+                play_games(pool, to - from, conf, 0, seed + from, [st, w](Game *gm, double ms) {
+                    st->add(gm->rec(), ms, w);
+                });
+            }
+            _exit(0);
+        }
+
+        st->workers_[w].pid_.store(pid);
+        if (pid < 0)
+            std::cout << "fork failed for worker " << w << "\n";
+    }
+
+    int running = 0;
+    for (int w = 0; w < workers; ++w)
+        running += st->workers_[w].pid_.load() > 0;
+
+    int crashed = workers - running;
+
+    while (running) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(report_ms));
+
+        int status;
+        pid_t pid;
+        while ((pid = waitpid(-1, &status, WNOHANG)) > 0) {
+            --running;
+
+            if (WIFEXITED(status) && !WEXITSTATUS(status))
+                continue;
+
+            ++crashed;
+            for (int w = 0; w < workers; ++w) {
+                if (st->workers_[w].pid_.load() == pid) {
+                    std::cout << "Worker " << w << " died";
+                    if (WIFSIGNALED(status))
+                        std::cout << " by signal " << WTERMSIG(status);
+                    std::cout << " after " << st->workers_[w].done_.load() << " games\n";
+                }
+            }
+        }
+
+        print_shard(*st, games, std::chrono::duration<double>(clock::now() - begin).count());
+    }
+
+    long long done = st->done_.load(std::memory_order_acquire);
+
+    std::cout << "Civillian win " << st->wins_[1].load() << "\n";
+    std::cout << "Mafia win " << st->wins_[2].load() << "\n";
+    std::cout << "Mana win " << st->wins_[3].load() << "\n";
+    std::cout << "Average days " << (done ? double(st->days_.load()) / done : 0) << "\n";
+    std::cout << "Kills mana " << st->kills_[MANA].load() << " coma " << st->kills_[COMA].load()
+        << " mafia " << st->kills_[MAFIA].load() << " kick " << st->kills_[VOTE].load()
+        << ", saves " << st->saves_.load() << "\n";
+
+    std::cout << "Days";
+    for (int d = 0; d < shard_days_; ++d)
+        if (st->days_hist_[d].load())
+            std::cout << " " << d << (d == shard_days_ - 1 ? "+:" : ":") << st->days_hist_[d].load();
+    std::cout << "\n";
+    if (crashed)
+        std::cout << "Crashed workers " << crashed << ", " << games - done << " games lost\n";
+    std::cout.flush();
+
+    munmap(mem, bytes);
+
+    return crashed;
+}
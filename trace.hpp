@@ -0,0 +1,170 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Optional timeline of host and player threads in Chrome/Perfetto
+// trace-event JSON. Every thread writes only to its own ring of events,
+// flush() reads them once the game is over. When the tracer is off a
+// Trace_scope costs one relaxed load.
+
+struct Trace_event
+{
+    const char *name_; // string literal
+    char ph_;          // 'B' - begin, 'E' - end
+    int arg_;
+    int64_t ts_;       // ns since enable()
+};
+
+struct Trace_buf
+{
+    std::unique_ptr<Trace_event[]> ev_;
+    size_t size_;      // power of two
+    std::atomic<size_t> head_{0};
+    int tid_;
+    std::string name_;
+
+    Trace_buf (const size_t &size, const int &tid) :
+        ev_(new Trace_event[size]),
+        size_(size),
+        tid_(tid)
+    {}
+
+    // only the owner thread pushes, old events are overwritten
+    void push(const Trace_event &e) {
+        size_t h = head_.load(std::memory_order_relaxed);
+        ev_[h & (size_ - 1)] = e;
+        head_.store(h + 1, std::memory_order_release);
+    }
+};
+
+class Tracer
+{
+    std::atomic<bool> on_{false};
+    size_t size_{1 << 12};
+    std::chrono::steady_clock::time_point begin_;
+    std::mutex mut_;
+    std::vector<std::unique_ptr<Trace_buf>> bufs_;
+
+    Trace_buf *buf(void) {
+        static thread_local Trace_buf *b = nullptr;
+
+        if (!b) {
+            std::lock_guard<std::mutex> lg{mut_};
+            bufs_.push_back(std::make_unique<Trace_buf>(size_, int(bufs_.size()) + 1));
+            b = bufs_.back().get();
+        }
+
+        return b;
+    }
+
+public:
+    bool on(void) const {
+        return on_.load(std::memory_order_relaxed);
+    }
+
+    // size - events kept per thread, rounded up to a power of two
+    void enable(size_t size = 1 << 12) {
+        size_ = 1;
+        while (size_ < size)
+            size_ <<= 1;
+
+        begin_ = std::chrono::steady_clock::now();
+        on_.store(true);
+    }
+
+    void record(const char *name, const char &ph, const int &arg) {
+        auto ts = std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now() - begin_).count();
+
+        buf()->push({name, ph, arg, ts});
+    }
+
+    void name_thread(const std::string &name) {
+        if (on())
+            buf()->name_ = name;
+    }
+
+    // call when the traced threads are done
+    bool flush(const std::string &path) {
+        std::ofstream out(path);
+        if (!out)
+            return false;
+
+        std::lock_guard<std::mutex> lg{mut_};
+        bool first = true;
+
+        out << "{\"traceEvents\":[\n";
+
+        for (auto &b : bufs_) {
+            size_t head = b->head_.load(std::memory_order_acquire);
+            size_t from = head > b->size_ ? head - b->size_ : 0;
+
+            if (!b->name_.empty()) {
+                out << (first ? "" : ",\n")
+                    << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << b->tid_
+                    << ",\"args\":{\"name\":\"" << b->name_ << "\"}}";
+                first = false;
+            }
+
+            for (size_t i = from; i < head; ++i) {
+                const Trace_event &e = b->ev_[i & (b->size_ - 1)];
+
+                out << (first ? "" : ",\n")
+                    << "{\"name\":\"" << e.name_ << "\",\"ph\":\"" << e.ph_
+                    << "\",\"ts\":" << e.ts_ / 1000 << "." << (e.ts_ % 1000) / 100 << (e.ts_ % 100) / 10 << e.ts_ % 10
+                    << ",\"pid\":1,\"tid\":" << b->tid_;
+                if (e.arg_ != -1)
+                    out << ",\"args\":{\"n\":" << e.arg_ << "}";
+                out << "}";
+                first = false;
+            }
+        }
+
+        out << "\n]}\n";
+
+        return bool(out);
+    }
+};
+
+Tracer &tracer(void) {
+    static Tracer t;
+    return t;
+}
+
+class Trace_scope
+{
+    const char *name_;
+    int arg_;
+    bool on_;
+
+public:
+    Trace_scope (const char *name, const int &arg = -1) :
+        name_(name),
+        arg_(arg),
+        on_(tracer().on())
+    {
+        if (on_)
+            tracer().record(name_, 'B', arg_);
+    }
+
+    Trace_scope (const Trace_scope &) = delete;
+    Trace_scope &operator=(const Trace_scope &) = delete;
+
+    ~Trace_scope() {
+        if (on_)
+            tracer().record(name_, 'E', arg_);
+    }
+};
+
+template <typename Barrier>
+void traced_wait(Barrier &bar, const int &who, const char *name) {
+    Trace_scope ts{name};
+    bar.arrive_and_wait(who);
+}